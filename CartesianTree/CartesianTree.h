@@ -1,306 +1,666 @@
-#include <iostream>
+#pragma once
+
+#include <atomic>
+#include <cstdint>
 #include <functional>
+#include <future>
+#include <iostream>
+#include <iterator>
+#include <numeric>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 
-class CartesianTree {
-private:
-    struct CTVertex {
-        CTVertex *left, *right, *parent;
-        std::size_t priority;
-        long long value;
-        long long leftistValue, rightistValue;
-
-        std::size_t size;
-        long long sum;
-        long long add;
-        bool isAssigned;
-        long long assignedValue;
-        bool isReversed;
-        std::size_t rightDecreasingSequenceSize;
-        std::size_t leftIncreasingSequenceSize;
-        std::size_t rightIncreasingSequenceSize;
-        std::size_t leftDecreasingSequenceSize;
-
-        explicit CTVertex(const int& value) : priority(rand()), value(value), 
-                                     sum(value), size(1), add(0), isAssigned(false),
-                                     isReversed(false), rightDecreasingSequenceSize(1),
-                                     leftIncreasingSequenceSize(1),
-                                     rightIncreasingSequenceSize(1),
-                                     leftDecreasingSequenceSize(1),
-                                     leftistValue(value), rightistValue(value) {}
-
-        ~CTVertex() {
-            if (left)
-                delete left;
-            if (right)
-                delete right;
-        }
+// Features of a CartesianTree. Aggregates keep a value over the subtree of
+// every vertex, tags are lazy operations on a segment. A feature adds its
+// own fields to the vertex and reacts to the hooks below; a tag is applied
+// to a vertex at once, so aggregates of a vertex are always up to date and
+// only its children are left to be pushed.
+struct CTFeature {
+    template <typename Value>
+    struct Fields {};
+
+    template <class Vertex>
+    static void update(Vertex&, const Vertex*, const Vertex*) {}
 
-        CTVertex(const CTVertex& another) 
-            : left(another.left ? new CTVertex(*another.left) : nullptr),
-              right(another.right ? new CTVertex(*another.right) : nullptr),
-              parent(another.parent ? new CTVertex(*another.parent) : nullptr),
-              priority(another.priority),
-              value(another.value),
-              leftistValue(another.leftistValue),
-              rightistValue(another.rightistValue),
-              size(another.size),
-              sum(another.sum),
-              add(another.add),
-              isAssigned(another.isAssigned),
-              assignedValue(another.assignedValue),
-              isReversed(another.isReversed),
-              rightDecreasingSequenceSize(another.rightDecreasingSequenceSize),
-              leftIncreasingSequenceSize(another.leftIncreasingSequenceSize),
-              rightIncreasingSequenceSize(another.rightIncreasingSequenceSize),
-              leftDecreasingSequenceSize(another.leftDecreasingSequenceSize) {}
+    template <class Vertex, typename Value>
+    static void onAdd(Vertex&, const Value&) {}
+
+    template <class Vertex, typename Value>
+    static void onAssign(Vertex&, const Value&) {}
+
+    template <class Vertex>
+    static void onReverse(Vertex&) {}
+};
+
+struct CTSum : CTFeature {
+    template <typename Value>
+    struct Fields {
+        Value sum = Value();
     };
 
-    static std::size_t size_(CTVertex* tree) {
-        return (tree ? tree->size : 0);
+    template <class Vertex>
+    static void update(Vertex& vertex, const Vertex* left, const Vertex* right) {
+        vertex.sum = vertex.value;
+        if (left)
+            vertex.sum += left->sum;
+        if (right)
+            vertex.sum += right->sum;
     }
 
-    static long long sum_(CTVertex* tree) {
-        return (tree ? (tree->isAssigned ? tree->assignedValue * tree->size : 
-            tree->sum + tree->add * tree->size) : 0);
+    template <class Vertex, typename Value>
+    static void onAdd(Vertex& vertex, const Value& add) {
+        vertex.sum += add * Value(vertex.size);
     }
 
-    static long long value_(CTVertex* tree) {
-        return (tree ? 
-            (tree->isAssigned ? tree->assignedValue : tree->value + tree->add) : 0);
+    template <class Vertex, typename Value>
+    static void onAssign(Vertex& vertex, const Value& value) {
+        vertex.sum = value * Value(vertex.size);
+    }
+};
+
+struct CTMin : CTFeature {
+    template <typename Value>
+    struct Fields {
+        Value minimum = Value();
+    };
+
+    template <class Vertex>
+    static void update(Vertex& vertex, const Vertex* left, const Vertex* right) {
+        vertex.minimum = vertex.value;
+        if (left && left->minimum < vertex.minimum)
+            vertex.minimum = left->minimum;
+        if (right && right->minimum < vertex.minimum)
+            vertex.minimum = right->minimum;
     }
 
-    CTVertex* left_(CTVertex* vertex) {
-        return (vertex ? (vertex->isReversed ? vertex->right : vertex->left) : 0);
+    template <class Vertex, typename Value>
+    static void onAdd(Vertex& vertex, const Value& add) {
+        vertex.minimum += add;
     }
 
-    CTVertex* right_(CTVertex* vertex) {
-        return (vertex ? (vertex->isReversed ? vertex->left : vertex->right) : 0);
+    template <class Vertex, typename Value>
+    static void onAssign(Vertex& vertex, const Value& value) {
+        vertex.minimum = value;
     }
+};
 
-    static std::size_t rightIncreasingSequenceSize_(CTVertex* tree) {
-        return (tree ? (tree->isAssigned ? tree->size :
-            (tree->isReversed ? tree->leftDecreasingSequenceSize :
-            tree->rightIncreasingSequenceSize)) : 0);
+struct CTMax : CTFeature {
+    template <typename Value>
+    struct Fields {
+        Value maximum = Value();
+    };
+
+    template <class Vertex>
+    static void update(Vertex& vertex, const Vertex* left, const Vertex* right) {
+        vertex.maximum = vertex.value;
+        if (left && vertex.maximum < left->maximum)
+            vertex.maximum = left->maximum;
+        if (right && vertex.maximum < right->maximum)
+            vertex.maximum = right->maximum;
     }
 
-    static std::size_t leftIncreasingSequenceSize_(CTVertex* tree) {
-        return (tree ? (tree->isAssigned ? tree->size :
-            (tree->isReversed ? tree->rightDecreasingSequenceSize :
-            tree->leftIncreasingSequenceSize)) : 0);
+    template <class Vertex, typename Value>
+    static void onAdd(Vertex& vertex, const Value& add) {
+        vertex.maximum += add;
     }
 
-    static std::size_t rightDecreasingSequenceSize_(CTVertex* tree) {
-        return (tree ? (tree->isAssigned ? tree->size :
-            (tree->isReversed ? tree->leftIncreasingSequenceSize :
-            tree->rightDecreasingSequenceSize)) : 0);
+    template <class Vertex, typename Value>
+    static void onAssign(Vertex& vertex, const Value& value) {
+        vertex.maximum = value;
     }
+};
+
+// Adding to a segment does not keep the gcd of a subtree, so CTGcd cannot be
+// combined with CTAdd.
+struct CTGcd : CTFeature {
+    template <typename Value>
+    struct Fields {
+        Value gcd = Value();
+    };
 
-    static std::size_t leftDecreasingSequenceSize_(CTVertex* tree) {
-        return (tree ? (tree->isAssigned ? tree->size :
-            (tree->isReversed ? tree->rightIncreasingSequenceSize :
-            tree->leftDecreasingSequenceSize)) : 0);
+    template <class Vertex>
+    static void update(Vertex& vertex, const Vertex* left, const Vertex* right) {
+        vertex.gcd = std::gcd(vertex.value, decltype(vertex.value)());
+        if (left)
+            vertex.gcd = std::gcd(vertex.gcd, left->gcd);
+        if (right)
+            vertex.gcd = std::gcd(vertex.gcd, right->gcd);
     }
 
-    static long long getLeftist_(CTVertex* tree) {
-        return (tree->isAssigned ? tree->assignedValue :
-            (tree->isReversed ? tree->rightistValue : tree->leftistValue) + tree->add);
+    template <class Vertex, typename Value>
+    static void onAdd(Vertex& vertex, const Value& add) = delete;
+
+    template <class Vertex, typename Value>
+    static void onAssign(Vertex& vertex, const Value& value) {
+        vertex.gcd = std::gcd(value, Value());
     }
+};
 
-    static long long getRightist_(CTVertex* tree) {
-        return (tree->isAssigned ? tree->assignedValue :
-            (tree->isReversed ? tree->leftistValue : tree->rightistValue) + tree->add);
+// Lengths of the longest monotone prefixes and suffixes, which is what
+// nextPermutation and prevPermutation need.
+struct CTMonotoneRuns : CTFeature {
+    template <typename Value>
+    struct Fields {
+        Value leftistValue = Value();
+        Value rightistValue = Value();
+        std::uint32_t leftIncreasingSequenceSize = 1;
+        std::uint32_t leftDecreasingSequenceSize = 1;
+        std::uint32_t rightIncreasingSequenceSize = 1;
+        std::uint32_t rightDecreasingSequenceSize = 1;
+    };
+
+    // A run that starts at the far end of the inner subtree has to cover it
+    // entirely before it reaches the vertex and continues into the outer one.
+    static std::uint32_t run_(std::uint32_t innerRun, std::uint32_t innerSize, bool reachesVertex,
+                              bool continues, std::uint32_t outerRun) {
+        if (innerRun != innerSize || !reachesVertex)
+            return innerRun;
+        return innerSize + 1 + (continues ? outerRun : 0);
     }
 
-    static void push_if_assigned_(CTVertex* vertex) {
-        if (vertex->isAssigned) {
-            if (vertex->left) {
-                vertex->left->add = 0;
-                vertex->left->isAssigned = true;
-                vertex->left->assignedValue = vertex->assignedValue;
-            }
-            if (vertex->right) {
-                vertex->right->add = 0;
-                vertex->right->isAssigned = true;
-                vertex->right->assignedValue = vertex->assignedValue;
-            }
-            vertex->value = vertex->assignedValue;
-            vertex->leftistValue = vertex->assignedValue;
-            vertex->rightistValue = vertex->assignedValue;
-            vertex->sum = vertex->assignedValue * vertex->size;
-            vertex->isAssigned = false;
-            vertex->rightDecreasingSequenceSize = vertex->size;
-            vertex->leftIncreasingSequenceSize = vertex->size;
-            vertex->rightIncreasingSequenceSize = vertex->size;
-            vertex->leftDecreasingSequenceSize = vertex->size;
+    template <class Vertex>
+    static void update(Vertex& vertex, const Vertex* left, const Vertex* right) {
+        const auto& value = vertex.value;
+        std::uint32_t leftSize = left ? left->size : 0;
+        std::uint32_t rightSize = right ? right->size : 0;
+        vertex.leftistValue = left ? left->leftistValue : value;
+        vertex.rightistValue = right ? right->rightistValue : value;
+        vertex.leftIncreasingSequenceSize = run_(
+            left ? left->leftIncreasingSequenceSize : 0, leftSize,
+            !left || !(value < left->rightistValue),
+            right && !(right->leftistValue < value), right ? right->leftIncreasingSequenceSize : 0);
+        vertex.leftDecreasingSequenceSize = run_(
+            left ? left->leftDecreasingSequenceSize : 0, leftSize,
+            !left || !(left->rightistValue < value),
+            right && !(value < right->leftistValue), right ? right->leftDecreasingSequenceSize : 0);
+        vertex.rightIncreasingSequenceSize = run_(
+            right ? right->rightIncreasingSequenceSize : 0, rightSize,
+            !right || !(right->leftistValue < value),
+            left && !(value < left->rightistValue), left ? left->rightIncreasingSequenceSize : 0);
+        vertex.rightDecreasingSequenceSize = run_(
+            right ? right->rightDecreasingSequenceSize : 0, rightSize,
+            !right || !(value < right->leftistValue),
+            left && !(left->rightistValue < value), left ? left->rightDecreasingSequenceSize : 0);
+    }
+
+    template <class Vertex, typename Value>
+    static void onAdd(Vertex& vertex, const Value& add) {
+        vertex.leftistValue += add;
+        vertex.rightistValue += add;
+    }
+
+    template <class Vertex, typename Value>
+    static void onAssign(Vertex& vertex, const Value& value) {
+        vertex.leftistValue = value;
+        vertex.rightistValue = value;
+        vertex.leftIncreasingSequenceSize = vertex.size;
+        vertex.leftDecreasingSequenceSize = vertex.size;
+        vertex.rightIncreasingSequenceSize = vertex.size;
+        vertex.rightDecreasingSequenceSize = vertex.size;
+    }
+
+    template <class Vertex>
+    static void onReverse(Vertex& vertex) {
+        std::swap(vertex.leftistValue, vertex.rightistValue);
+        std::swap(vertex.leftIncreasingSequenceSize, vertex.rightDecreasingSequenceSize);
+        std::swap(vertex.leftDecreasingSequenceSize, vertex.rightIncreasingSequenceSize);
+    }
+};
+
+// Pending addition for the children. An assignment drops it, and pushing
+// applies a pending assignment before a pending addition.
+struct CTAdd : CTFeature {
+    template <typename Value>
+    struct Fields {
+        Value add = Value();
+    };
+
+    template <class Vertex, typename Value>
+    static void onAdd(Vertex& vertex, const Value& add) {
+        vertex.add += add;
+    }
+
+    template <class Vertex, typename Value>
+    static void onAssign(Vertex& vertex, const Value&) {
+        vertex.add = Value();
+    }
+};
+
+struct CTAssign : CTFeature {
+    template <typename Value>
+    struct Fields {
+        bool isAssigned = false;
+        Value assignedValue = Value();
+    };
+
+    template <class Vertex, typename Value>
+    static void onAssign(Vertex& vertex, const Value& value) {
+        vertex.isAssigned = true;
+        vertex.assignedValue = value;
+    }
+};
+
+struct CTReverse : CTFeature {
+    template <typename Value>
+    struct Fields {
+        bool isReversed = false;
+    };
+
+    template <class Vertex>
+    static void onReverse(Vertex& vertex) {
+        vertex.isReversed ^= true;
+    }
+};
+
+// Not a feature but a storage option: vertices live in one vector and are
+// linked by 32-bit indices instead of pointers, with a free list for erased
+// vertices. Links take half the space and vertices stay close together.
+struct CTIndexPool : CTFeature {};
+
+// Storage option for persistent trees: copying a tree is O(1), and the
+// copies share their vertices. A vertex shared by several versions is never
+// changed; split and merge copy the vertices on their path instead, so an
+// update costs O(log n) new vertices, and vertices no version reaches any
+// more are freed by reference counting. Versions of one tree may be copied
+// and used from different threads (each CartesianTree object still by one
+// thread at a time), so readers can query a frozen copy while the writer
+// goes on with the original. Needs pointer links.
+struct CTPersistent : CTFeature {
+    // A copy of a vertex is a new vertex with a single reference.
+    struct RefCount {
+        std::atomic<std::uint32_t> count;
+
+        RefCount() : count(1) {}
+
+        RefCount(const RefCount&) : count(1) {}
+
+        RefCount& operator=(const RefCount&) {
+            return *this;
         }
+    };
+
+    template <typename Value>
+    struct Fields {
+        RefCount refs;
+    };
+};
+
+
+
+namespace _cartesian_tree {
+    template <class Feature, class... Features>
+    struct contains : std::disjunction<std::is_same<Feature, Features>...> {};
+
+    // Keeps the bases of a vertex distinct even if several features
+    // inherit the empty CTFeature::Fields.
+    template <class Feature, typename Value>
+    struct FieldsOf : Feature::template Fields<Value> {};
+
+    template <typename Value, bool indexed, class... Features>
+    struct Vertex : FieldsOf<Features, Value>... {
+        typedef typename std::conditional<indexed, std::uint32_t, Vertex*>::type Link;
+
+        Link left, right;
+        std::uint32_t priority;
+        std::uint32_t size;
+        Value value;
+
+        Vertex(const Value& value, std::uint32_t priority)
+            : left(), right(), priority(priority), size(1), value(value) {}
+    };
+
+    inline std::uint32_t randomPriority() {
+        static thread_local std::uint32_t state = 2463534242u;
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
     }
 
-    static void push_if_added_(CTVertex* vertex) {
-        if (vertex->add) {
-            if (vertex->left) {
-                if (vertex->left->isAssigned)
-                    vertex->left->assignedValue += vertex->add;
-                else
-                    vertex->left->add += vertex->add;
-            }
-            if (vertex->right) {
-                if (vertex->right->isAssigned)
-                    vertex->right->assignedValue += vertex->add;
-                else
-                    vertex->right->add += vertex->add;
+    template <class Vertex>
+    class PointerStorage {
+    public:
+        typedef Vertex* Link;
+
+        Vertex* at(Link link) const {
+            return link;
+        }
+
+        std::uint32_t size(Link link) const {
+            return link ? link->size : 0;
+        }
+
+        template <typename Value>
+        Link create(const Value& value) {
+            return new Vertex(value, randomPriority());
+        }
+
+        void destroy(Link link) {
+            delete link;
+        }
+
+        void reserve(std::size_t) {}
+    };
+
+    // Index 0 is the null link and holds an empty sentinel, so sizes are read
+    // without a branch. Erased vertices are chained through their left links.
+    // create() may move every vertex, so no Vertex* may be held across it.
+    template <class Vertex>
+    class IndexStorage {
+    private:
+        std::vector<Vertex> vertices_;
+        std::uint32_t free_;
+
+    public:
+        typedef std::uint32_t Link;
+
+        IndexStorage() : vertices_(1, Vertex(decltype(Vertex::value)(), 0)), free_(0) {
+            vertices_[0].size = 0;
+        }
+
+        Vertex* at(Link link) {
+            return link ? &vertices_[link] : nullptr;
+        }
+
+        const Vertex* at(Link link) const {
+            return link ? &vertices_[link] : nullptr;
+        }
+
+        std::uint32_t size(Link link) const {
+            return vertices_[link].size;
+        }
+
+        template <typename Value>
+        Link create(const Value& value) {
+            if (free_) {
+                Link link = free_;
+                free_ = vertices_[link].left;
+                vertices_[link] = Vertex(value, randomPriority());
+                return link;
             }
-            vertex->value += vertex->add;
-            vertex->leftistValue += vertex->add;
-            vertex->rightistValue += vertex->add;
-            vertex->sum += vertex->size * vertex->add;
-            vertex->add = 0;
+            vertices_.emplace_back(value, randomPriority());
+            return Link(vertices_.size() - 1);
         }
-    }
 
-    static void push_if_reversed_(CTVertex* vertex) {
-        if (vertex->isReversed) {
-            if (vertex->left)
-                vertex->left->isReversed ^= true;
-            if (vertex->right)
-                vertex->right->isReversed ^= true;
-            std::swap(vertex->left, vertex->right);
-            vertex->isReversed = false;
-            std::swap(vertex->leftIncreasingSequenceSize,
-                      vertex->rightDecreasingSequenceSize);
-            std::swap(vertex->leftDecreasingSequenceSize,
-                      vertex->rightIncreasingSequenceSize);
-            std::swap(vertex->leftistValue, vertex->rightistValue);
+        void destroy(Link link) {
+            vertices_[link].left = free_;
+            free_ = link;
         }
-    }
 
-    static void push_(CTVertex* vertex) {
-        if (vertex) {
-            push_if_assigned_(vertex);
-            push_if_added_(vertex);
-            push_if_reversed_(vertex);    
+        void reserve(std::size_t size) {
+            vertices_.reserve(size + 1);
         }
+    };
+}
+
+
+// Implicit treap over a sequence of Value. Only the listed features are
+// stored in the vertices; CartesianTree<> (or CartesianTree<Value>) keeps
+// the full set: sums, monotone runs, range add, assign and reverse.
+// Listing CTIndexPool keeps the vertices in a pool linked by indices.
+// With CTPersistent copies are O(1) versions that share vertices.
+template <typename Value = long long, class... Features>
+class CartesianTree {
+private:
+    template <class Feature>
+    static constexpr bool has_ = _cartesian_tree::contains<Feature, Features...>::value;
+
+    typedef _cartesian_tree::Vertex<Value, has_<CTIndexPool>, Features...> CTVertex;
+    typedef typename std::conditional<has_<CTIndexPool>,
+                                      _cartesian_tree::IndexStorage<CTVertex>,
+                                      _cartesian_tree::PointerStorage<CTVertex>>::type Storage;
+    typedef typename CTVertex::Link Link;
+
+    static_assert(!(has_<CTPersistent> && has_<CTIndexPool>),
+                  "CTPersistent needs pointer links and cannot be combined with CTIndexPool");
+
+    CTVertex* at_(Link link) {
+        return storage_.at(link);
     }
 
-    template <class Comparator>
-    static void updateSequenceSize_(CTVertex* vertex, std::size_t (*getSequenceSize)(CTVertex*), 
-            long long (*first)(CTVertex*), long long (*second)(CTVertex*),
-            CTVertex* firstChild, CTVertex* secondChild, std::size_t& result, Comparator cmp) {
-        result = getSequenceSize(firstChild);
-        if (result == size_(firstChild) && (!firstChild || !cmp(value_(vertex), first(firstChild))))
-            ++result;
-        if ((result == size_(firstChild) + 1) && secondChild && !cmp(second(secondChild), value_(vertex)))
-            result += getSequenceSize(secondChild);
+    std::uint32_t size_(Link tree) const {
+        return storage_.size(tree);
     }
 
+    void update_(Link link) {
+        CTVertex* vertex = at_(link);
+        vertex->size = size_(vertex->left) + size_(vertex->right) + 1;
+        (Features::update(*vertex, at_(vertex->left), at_(vertex->right)), ...);
+    }
 
-    static void update_(CTVertex* vertex) {
-        if (!vertex)
+    void applyAdd_(Link link, const Value& add) {
+        if (!link)
             return;
-        vertex->size = size_(vertex->left) + size_(vertex->right) + 1;
-        vertex->sum = sum_(vertex->left) + sum_(vertex->right) + value_(vertex);
-        vertex->leftistValue = vertex->left ? getLeftist_(vertex->left) : value_(vertex);
-        vertex->rightistValue = vertex->right ? getRightist_(vertex->right) : value_(vertex);
-        
-        updateSequenceSize_(vertex, rightDecreasingSequenceSize_, getLeftist_, getRightist_,
-                            vertex->right, vertex->left, vertex->rightDecreasingSequenceSize, std::less<long long>());
-        updateSequenceSize_(vertex, leftIncreasingSequenceSize_, getRightist_, getLeftist_,
-                            vertex->left, vertex->right, vertex->leftIncreasingSequenceSize, std::less<long long>());
-        updateSequenceSize_(vertex, leftDecreasingSequenceSize_, getRightist_, getLeftist_,
-                            vertex->left, vertex->right, vertex->leftDecreasingSequenceSize, std::greater<long long>());
-        updateSequenceSize_(vertex, rightIncreasingSequenceSize_, getLeftist_, getRightist_,
-                            vertex->right, vertex->left, vertex->rightIncreasingSequenceSize, std::greater<long long>());
-    }
-
-    static void merge_(CTVertex* leftTree, CTVertex* rightTree, CTVertex*& result) {
-        push_(leftTree);
-        push_(rightTree);
-        if (!leftTree || !rightTree) {
-            result = (leftTree ? leftTree : rightTree);
-            update_(result);
+        CTVertex* vertex = at_(link);
+        vertex->value += add;
+        (Features::onAdd(*vertex, add), ...);
+    }
+
+    void applyAssign_(Link link, const Value& value) {
+        if (!link)
             return;
+        CTVertex* vertex = at_(link);
+        vertex->value = value;
+        (Features::onAssign(*vertex, value), ...);
+    }
+
+    void applyReverse_(Link link) {
+        if (!link)
+            return;
+        CTVertex* vertex = at_(link);
+        std::swap(vertex->left, vertex->right);
+        (Features::onReverse(*vertex), ...);
+    }
+
+    // Makes link the only reference to its vertex before the vertex is
+    // changed: a vertex still shared with other versions is replaced by a
+    // copy that shares its children. Only persistent trees share vertices.
+    void own_(Link& link) {
+        if constexpr (has_<CTPersistent>) {
+            if (!link || at_(link)->refs.count.load(std::memory_order_acquire) == 1)
+                return;
+            CTVertex* copy = new CTVertex(*at_(link));
+            if (copy->left)
+                copy->left->refs.count.fetch_add(1, std::memory_order_relaxed);
+            if (copy->right)
+                copy->right->refs.count.fetch_add(1, std::memory_order_relaxed);
+            deleteTree_(link);
+            link = copy;
         }
-        if (leftTree->priority >= rightTree->priority) {
-            result = leftTree;
-            merge_(result->right, rightTree, result->right);
-            if (result->right)
-                result->right->parent = result;
-        }
-        else {
-            result = rightTree;
-            merge_(leftTree, result->left, result->left);
-            if (result->left)
-                result->left->parent = result;
-        }
-        update_(result);
     }
 
-    static void split_(CTVertex* tree, const std::size_t& leftSize,
-               CTVertex*& leftTree, CTVertex*& rightTree) {
-        if (!tree) {
-            leftTree = nullptr;
-            rightTree = nullptr;
+    // The vertex itself has to be owned; children get owned here before a
+    // tag is pushed into them.
+    void push_(Link link) {
+        CTVertex* vertex = at_(link);
+        if constexpr (has_<CTReverse>)
+            if (vertex->isReversed) {
+                own_(vertex->left);
+                own_(vertex->right);
+                applyReverse_(vertex->left);
+                applyReverse_(vertex->right);
+                vertex->isReversed = false;
+            }
+        if constexpr (has_<CTAssign>)
+            if (vertex->isAssigned) {
+                own_(vertex->left);
+                own_(vertex->right);
+                applyAssign_(vertex->left, vertex->assignedValue);
+                applyAssign_(vertex->right, vertex->assignedValue);
+                vertex->isAssigned = false;
+            }
+        if constexpr (has_<CTAdd>)
+            if (vertex->add != Value()) {
+                own_(vertex->left);
+                own_(vertex->right);
+                applyAdd_(vertex->left, vertex->add);
+                applyAdd_(vertex->right, vertex->add);
+                vertex->add = Value();
+            }
+    }
+
+    Link newVertex_(const Value& value) {
+        Link vertex = storage_.create(value);
+        update_(vertex);
+        return vertex;
+    }
+
+    // In a persistent tree this drops one reference and frees only the
+    // vertices that are not reached from anywhere else.
+    void deleteTree_(Link tree) {
+        if (!tree)
             return;
+        if constexpr (has_<CTPersistent>)
+            if (at_(tree)->refs.count.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                return;
+        deleteTree_(at_(tree)->left);
+        deleteTree_(at_(tree)->right);
+        storage_.destroy(tree);
+    }
+
+    static CTVertex* copyTree_(const CTVertex* tree) {
+        if (!tree)
+            return nullptr;
+        CTVertex* copy = new CTVertex(*tree);
+        copy->left = copyTree_(tree->left);
+        copy->right = copyTree_(tree->right);
+        return copy;
+    }
+
+    // Vertices passed by an iterative split or merge. An expected treap path
+    // fits in the inline part; deeper ones spill to the heap.
+    class PathStack_ {
+    private:
+        static const std::size_t inlineSize_ = 64;
+        Link inline_[inlineSize_];
+        std::vector<Link> spilled_;
+        std::size_t size_ = 0;
+
+    public:
+        void push(Link vertex) {
+            if (size_ < inlineSize_)
+                inline_[size_] = vertex;
+            else
+                spilled_.push_back(vertex);
+            ++size_;
         }
-        push_(tree);
-        if (size_(tree->left) >= leftSize) {
-            split_(tree->left, leftSize, leftTree, tree->left);
-            rightTree = tree;
-            if (leftTree)
-                leftTree->parent = nullptr;
-            if (rightTree->left)
-                rightTree->left->parent = rightTree;
+
+        Link pop() {
+            if (--size_ < inlineSize_)
+                return inline_[size_];
+            Link vertex = spilled_.back();
+            spilled_.pop_back();
+            return vertex;
         }
-        else {
-            split_(tree->right, leftSize - size_(tree->left) - 1,
-                  tree->right, rightTree);
-            leftTree = tree;
-            if (rightTree)
-                rightTree->parent = nullptr;
-            if (leftTree->right)
-                leftTree->right->parent = leftTree;
+
+        bool empty() const {
+            return size_ == 0;
         }
-        update_(tree);
+    };
+
+    // Walks down once, hanging every vertex it passes into the result, and
+    // then updates the passed vertices bottom-up from an explicit path, so
+    // the depth of the tree never reaches the call stack.
+    void merge_(Link leftTree, Link rightTree, Link& result) {
+        PathStack_ path;
+        Link* hole = &result;
+        while (leftTree && rightTree) {
+            if (at_(leftTree)->priority >= at_(rightTree)->priority) {
+                own_(leftTree);
+                push_(leftTree);
+                path.push(leftTree);
+                *hole = leftTree;
+                hole = &at_(leftTree)->right;
+                leftTree = *hole;
+            }
+            else {
+                own_(rightTree);
+                push_(rightTree);
+                path.push(rightTree);
+                *hole = rightTree;
+                hole = &at_(rightTree)->left;
+                rightTree = *hole;
+            }
+        }
+        *hole = (leftTree ? leftTree : rightTree);
+        while (!path.empty())
+            update_(path.pop());
     }
 
-    template <class Comparator>
-    static std::size_t extremeVertexValue_(CTVertex* tree, const long long& val, Comparator cmp) {
-        push_(tree);
-        if (tree->left && !cmp(value_(tree), val))
-            return extremeVertexValue_(tree->left, val, cmp);
-        if (tree->right && cmp(value_(tree), val)) {
-            auto t = extremeVertexValue_(tree->right, val, cmp);
-            if (t)
-                return size_(tree->left) + 1 + t;
+    // Vertices that go to the left part hang on leftHole, the others on
+    // rightHole; each hole then moves to the child that is still to split.
+    void split_(Link tree, std::size_t leftSize, Link& leftTree, Link& rightTree) {
+        PathStack_ path;
+        Link* leftHole = &leftTree;
+        Link* rightHole = &rightTree;
+        while (tree) {
+            own_(tree);
+            push_(tree);
+            path.push(tree);
+            CTVertex* vertex = at_(tree);
+            if (size_(vertex->left) >= leftSize) {
+                *rightHole = tree;
+                rightHole = &vertex->left;
+                tree = vertex->left;
+            }
+            else {
+                leftSize -= size_(vertex->left) + 1;
+                *leftHole = tree;
+                leftHole = &vertex->right;
+                tree = vertex->right;
+            }
         }
-        if (cmp(value_(tree), val))
-            return size_(tree->left) + 1;
-        return 0;
+        *leftHole = Link();
+        *rightHole = Link();
+        while (!path.empty())
+            update_(path.pop());
     }
 
-    void insert_(CTVertex*& tree, const std::size_t& index, const long long& value) {
-        if (!tree) {
-            tree = new CTVertex(value);
-            return;
+    // Position (from 1) of the last vertex with cmp(value, val) in a tree that
+    // is monotone with respect to cmp, or 0 if there is none.
+    template <class Comparator>
+    std::size_t extremeVertexValue_(Link tree, const Value& val, Comparator cmp) {
+        std::size_t skipped = 0, found = 0;
+        while (tree) {
+            push_(tree);
+            CTVertex* vertex = at_(tree);
+            if (cmp(vertex->value, val)) {
+                found = skipped + size_(vertex->left) + 1;
+                skipped = found;
+                own_(vertex->right);
+                tree = vertex->right;
+            }
+            else {
+                own_(vertex->left);
+                tree = vertex->left;
+            }
         }
-        CTVertex *leftTree, *rightTree;
+        return found;
+    }
+
+    void insert_(Link& tree, const std::size_t& index, const Value& value) {
+        Link newElement = newVertex_(value);
+        Link leftTree, rightTree;
         split_(tree, index, leftTree, rightTree);
-        CTVertex* newElement = new CTVertex(value);
         merge_(leftTree, newElement, tree);
         merge_(tree, rightTree, tree);
     }
 
-    void erase_(CTVertex*& tree, const std::size_t& index) {
-        CTVertex *leftTree, *rightTree, *erasedElement;
+    void erase_(Link& tree, const std::size_t& index) {
+        Link leftTree, rightTree, erasedElement;
         split_(tree, index, leftTree, rightTree);
         split_(rightTree, 1, erasedElement, rightTree);
+        deleteTree_(erasedElement);
         merge_(leftTree, rightTree, tree);
     }
 
     template <class OperationOnSegment>
-    void doSomethingOnSegment(CTVertex* tree, const std::size_t& l, const std::size_t& r,
+    void doSomethingOnSegment(Link& tree, const std::size_t& l, const std::size_t& r,
                               OperationOnSegment something) {
-        CTVertex *leftTree, *middleTree, *rightTree;
+        Link leftTree, middleTree, rightTree;
         split_(tree, l, leftTree, middleTree);
         split_(middleTree, r - l + 1, middleTree, rightTree);
         something(middleTree);
@@ -308,129 +668,291 @@ private:
         merge_(tree, rightTree, tree);
     }
 
-    template <class Comparator>
-    static void followingPermutation_(CTVertex* middleTree,
-            std::size_t (*rightSequenceSize)(CTVertex*), Comparator cmp) {
-        if (size_(middleTree) == rightSequenceSize(middleTree))
-            middleTree->isReversed ^= true;
+    template <class RightSequenceSize, class Comparator>
+    void followingPermutation_(Link& middleTree,
+            RightSequenceSize rightSequenceSize, Comparator cmp) {
+        if (size_(middleTree) == rightSequenceSize(at_(middleTree)))
+            applyReverse_(middleTree);
         else {
-            CTVertex *subMiddleTree1, *subMiddleTree2, *subLeftTree, *pred;
-            split_(middleTree, size_(middleTree) - rightSequenceSize(middleTree),
+            Link subMiddleTree1, subMiddleTree2, subLeftTree, pred;
+            split_(middleTree, size_(middleTree) - rightSequenceSize(at_(middleTree)),
                    subMiddleTree1, subMiddleTree2);
-            split_(subMiddleTree1, subMiddleTree1->size - 1, subLeftTree, pred);
-            std::size_t upperBound = extremeVertexValue_(subMiddleTree2, value_(pred), cmp);
-            CTVertex *subSubLeft, *subSubRight, *subSubMiddle;
+            split_(subMiddleTree1, size_(subMiddleTree1) - 1, subLeftTree, pred);
+            std::size_t upperBound = extremeVertexValue_(subMiddleTree2, at_(pred)->value, cmp);
+            Link subSubLeft, subSubRight, subSubMiddle;
             split_(subMiddleTree2, upperBound - 1, subSubLeft, subSubMiddle);
             split_(subSubMiddle, 1, subSubMiddle, subSubRight);
-            std::swap(subSubMiddle->value, pred->value);
-            std::swap(subSubMiddle->sum, pred->sum);
+            std::swap(at_(subSubMiddle)->value, at_(pred)->value);
+            update_(subSubMiddle);
+            update_(pred);
             merge_(subSubLeft, subSubMiddle, subMiddleTree2);
             merge_(subMiddleTree2, subSubRight, subMiddleTree2);
-            subMiddleTree2->isReversed ^= true;
+            applyReverse_(subMiddleTree2);
             merge_(subLeftTree, pred, subMiddleTree1);
             merge_(subMiddleTree1, subMiddleTree2, middleTree);
         }
     }
 
-    long long getSum_(CTVertex* tree, const std::size_t& l, const std::size_t& r) {
-        long long ans;
-        doSomethingOnSegment(tree, l, r, [&ans](CTVertex* tree) {
-                                            ans = sum_(tree);
+    template <class Aggregate>
+    Value getAggregate_(Link& tree, const std::size_t& l, const std::size_t& r,
+                        Aggregate aggregate) {
+        Value ans = Value();
+        doSomethingOnSegment(tree, l, r, [this, &ans, &aggregate](Link tree) {
+                                            ans = aggregate(at_(tree));
                                         });
         return ans;
     }
 
-    void addOnSegment_(CTVertex* tree, const std::size_t& l, const std::size_t& r,
-                       const long long& add) {
-        doSomethingOnSegment(tree, l, r, [&add](CTVertex* tree) {
-                                             tree->add += add;
-                                         });
+    // Splits a tree sorted by value into the values less than key, the
+    // vertex equal to key (detached, if there is one) and the greater ones.
+    void splitByValue_(Link tree, const Value& key, Link& lessTree, Link& equal, Link& greaterTree) {
+        PathStack_ path;
+        Link* lessHole = &lessTree;
+        Link* greaterHole = &greaterTree;
+        equal = Link();
+        while (tree) {
+            own_(tree);
+            push_(tree);
+            CTVertex* vertex = at_(tree);
+            if (vertex->value < key) {
+                path.push(tree);
+                *lessHole = tree;
+                lessHole = &vertex->right;
+                tree = vertex->right;
+            }
+            else if (key < vertex->value) {
+                path.push(tree);
+                *greaterHole = tree;
+                greaterHole = &vertex->left;
+                tree = vertex->left;
+            }
+            else {
+                *lessHole = vertex->left;
+                *greaterHole = vertex->right;
+                vertex->left = Link();
+                vertex->right = Link();
+                update_(tree);
+                equal = tree;
+                break;
+            }
+        }
+        if (!equal) {
+            *lessHole = Link();
+            *greaterHole = Link();
+        }
+        while (!path.empty())
+            update_(path.pop());
     }
 
-    void assignOnSegment_(CTVertex* tree, const std::size_t& l, const std::size_t& r,
-                         const long long& assignedValue) {
-        doSomethingOnSegment(tree, l, r, [&assignedValue](CTVertex* tree) {
-                                             tree->isAssigned = true;
-                                             tree->assignedValue = assignedValue;
-                                         });
+    static const std::size_t parallelGrain_ = 1 << 16;
+
+    // Runs both halves of a set operation, the first one on another thread
+    // while there are threads to spare and enough work to pay for one.
+    template <class First, class Second>
+    static void forkJoin_(unsigned threads, std::size_t work, First first, Second second) {
+        if (threads < 2 || work < parallelGrain_) {
+            first();
+            second();
+            return;
+        }
+        std::future<void> forked = std::async(std::launch::async, first);
+        second();
+        forked.get();
     }
 
-    void reverse_(CTVertex* tree, const std::size_t& l, const std::size_t& r) {
-        doSomethingOnSegment(tree, l, r, [](CTVertex* tree) {
-                                             tree->isReversed ^= true;
-                                         });
+    // Join-based set operations on trees sorted by value (Blelloch et al.).
+    // The root with the higher priority splits the other tree by its value;
+    // the two sides are independent, and the root outranks everything in
+    // them, so joining them back under it keeps the heap order.
+    Link union_(Link first, Link second, unsigned threads) {
+        if (!first || !second)
+            return first ? first : second;
+        if (at_(first)->priority < at_(second)->priority)
+            std::swap(first, second);
+        std::size_t work = size_(first) + size_(second);
+        own_(first);
+        push_(first);
+        CTVertex* pivot = at_(first);
+        Link secondLess, equal, secondGreater;
+        splitByValue_(second, pivot->value, secondLess, equal, secondGreater);
+        deleteTree_(equal);
+        forkJoin_(threads, work,
+                  [&]() { pivot->left = union_(pivot->left, secondLess, threads / 2); },
+                  [&]() { pivot->right = union_(pivot->right, secondGreater, threads - threads / 2); });
+        update_(first);
+        return first;
     }
 
-    void nextPermutation_(CTVertex* tree, const std::size_t& l, const std::size_t& r) {
-        doSomethingOnSegment(tree, l, r, [](CTVertex* tree){
-                    followingPermutation_(tree, rightDecreasingSequenceSize_, std::greater<long long>());
-                    });
+    Link intersection_(Link first, Link second, unsigned threads) {
+        if (!first || !second) {
+            deleteTree_(first);
+            deleteTree_(second);
+            return Link();
+        }
+        if (at_(first)->priority < at_(second)->priority)
+            std::swap(first, second);
+        std::size_t work = size_(first) + size_(second);
+        own_(first);
+        push_(first);
+        CTVertex* pivot = at_(first);
+        Link secondLess, equal, secondGreater, lessTree, greaterTree;
+        splitByValue_(second, pivot->value, secondLess, equal, secondGreater);
+        forkJoin_(threads, work,
+                  [&]() { lessTree = intersection_(pivot->left, secondLess, threads / 2); },
+                  [&]() { greaterTree = intersection_(pivot->right, secondGreater, threads - threads / 2); });
+        return joinOrDrop_(first, lessTree, greaterTree, equal, bool(equal));
     }
 
-    void prevPermutation_(CTVertex* tree, const std::size_t& l, const std::size_t& r) {
-        doSomethingOnSegment(tree, l, r, [](CTVertex* tree){
-                    followingPermutation_(tree, rightIncreasingSequenceSize_, std::less<long long>());
-                    });
+    Link difference_(Link first, Link second, unsigned threads) {
+        if (!first || !second) {
+            deleteTree_(second);
+            return first;
+        }
+        std::size_t work = size_(first) + size_(second);
+        own_(first);
+        push_(first);
+        CTVertex* pivot = at_(first);
+        Link secondLess, equal, secondGreater, lessTree, greaterTree;
+        splitByValue_(second, pivot->value, secondLess, equal, secondGreater);
+        forkJoin_(threads, work,
+                  [&]() { lessTree = difference_(pivot->left, secondLess, threads / 2); },
+                  [&]() { greaterTree = difference_(pivot->right, secondGreater, threads - threads / 2); });
+        return joinOrDrop_(first, lessTree, greaterTree, equal, !equal);
     }
 
-    void inOrder_(CTVertex* tree) {
+    // Hangs lessTree and greaterTree under pivot, or frees pivot and merges
+    // them; either way the duplicate from the other tree is freed.
+    Link joinOrDrop_(Link pivot, Link lessTree, Link greaterTree, Link duplicate, bool keep) {
+        deleteTree_(duplicate);
+        CTVertex* vertex = at_(pivot);
+        if (keep) {
+            vertex->left = lessTree;
+            vertex->right = greaterTree;
+            update_(pivot);
+            return pivot;
+        }
+        vertex->left = Link();
+        vertex->right = Link();
+        deleteTree_(pivot);
+        Link result;
+        merge_(lessTree, greaterTree, result);
+        return result;
+    }
+
+    void inOrder_(Link tree) {
         if (!tree)
             return;
         push_(tree);
-        inOrder_(tree->left);
-        std::cout << value_(tree) << " ";
-        inOrder_(tree->right);
+        own_(at_(tree)->left);
+        own_(at_(tree)->right);
+        inOrder_(at_(tree)->left);
+        std::cout << at_(tree)->value << " ";
+        inOrder_(at_(tree)->right);
     }
 
-    void read_(CTVertex*& tree) {
-        long long n, v, prior;
-        std::cin >> n;
-        for (int i = 0; i < n; ++i) {
-            std::cin >> v;
-            CTVertex* newVertex = new CTVertex(v);
-            if (!tree)
-                tree = newVertex;
-            else if (newVertex->priority >= tree->priority) {
-                tree->parent = newVertex;
-                newVertex->left = tree;
-                std::swap(tree, newVertex);
-                update_(tree);
-            }
-            else {
-                CTVertex* tmp = tree;
-                while (tmp->right && tmp->right->priority > newVertex->priority)
-                    tmp = tmp->right;
-                if (!tmp->right) {
-                    tmp->right = newVertex;
-                    newVertex->parent = tmp;
-                }
-                else {
-                    newVertex->left = tmp->right;
-                    newVertex->left->parent = newVertex;
-                    tmp->right = newVertex;
-                    newVertex->parent = tmp;
-                    tmp = newVertex;
-                }
-                while (tmp) {
-                    update_(tmp);
-                    tmp = tmp->parent;
-                }
+    // Builds the tree from n values handed out by nextValue() in O(n): the
+    // right spine is kept on a stack, and a vertex popped from it will not
+    // get any more descendants, so updating it on the pop visits the tree
+    // in post-order and computes every aggregate once.
+    template <class NextValue>
+    void build_(std::size_t n, NextValue nextValue) {
+        if constexpr (has_<CTIndexPool>)
+            storage_ = Storage();
+        else
+            deleteTree_(tree_);
+        tree_ = Link();
+        storage_.reserve(n);
+        std::vector<Link> spine;
+        for (std::size_t i = 0; i < n; ++i) {
+            Link vertex = storage_.create(nextValue());
+            Link lastPopped = Link();
+            while (!spine.empty() && at_(spine.back())->priority < at_(vertex)->priority) {
+                lastPopped = spine.back();
+                update_(lastPopped);
+                spine.pop_back();
             }
+            at_(vertex)->left = lastPopped;
+            if (!spine.empty())
+                at_(spine.back())->right = vertex;
+            spine.push_back(vertex);
+        }
+        if (!spine.empty())
+            tree_ = spine.front();
+        while (!spine.empty()) {
+            update_(spine.back());
+            spine.pop_back();
         }
     }
 
+    void read_() {
+        std::size_t n;
+        std::cin >> n;
+        build_(n, []() {
+            Value v;
+            std::cin >> v;
+            return v;
+        });
+    }
+
 
-    CTVertex* tree_;
+    Storage storage_;
+    Link tree_;
 
 public:
-    CartesianTree() : tree_(nullptr) {}
+    CartesianTree() : tree_() {}
+
+    // Builds from a range of values in linear time.
+    template <class ForwardIterator>
+    CartesianTree(ForwardIterator first, ForwardIterator last) : tree_() {
+        build(first, last);
+    }
+
+    // O(1) for a persistent tree, which only takes a reference to the root.
+    CartesianTree(const CartesianTree& another) : storage_(another.storage_), tree_(another.tree_) {
+        if constexpr (has_<CTPersistent>) {
+            if (tree_)
+                tree_->refs.count.fetch_add(1, std::memory_order_relaxed);
+        }
+        else if constexpr (!has_<CTIndexPool>)
+            tree_ = copyTree_(another.tree_);
+    }
+
+    CartesianTree(CartesianTree&& another) : storage_(std::move(another.storage_)), tree_(another.tree_) {
+        another.storage_ = Storage();
+        another.tree_ = Link();
+    }
+
+    CartesianTree& operator=(CartesianTree another) {
+        std::swap(storage_, another.storage_);
+        std::swap(tree_, another.tree_);
+        return *this;
+    }
+
+    ~CartesianTree() {
+        if constexpr (!has_<CTIndexPool>)
+            deleteTree_(tree_);
+    }
 
-    CartesianTree(const CartesianTree& another) : 
-                        tree_(new CTVertex(*another.tree_)) {}
+    std::size_t size() const {
+        return size_(tree_);
+    }
+
+    // Only the index pool can reserve room for vertices in advance.
+    void reserve(std::size_t size) {
+        storage_.reserve(size);
+    }
 
-    ~CartesianTree() {}
+    // Replaces the contents with the values of a range in linear time.
+    template <class ForwardIterator>
+    void build(ForwardIterator first, ForwardIterator last) {
+        build_(std::distance(first, last), [&first]() { return *first++; });
+    }
 
-    void insert(const std::size_t& index, const long long& value) {
+    void build(const std::vector<Value>& values) {
+        build(values.begin(), values.end());
+    }
+
+    void insert(const std::size_t& index, const Value& value) {
         insert_(tree_, index, value);
     }
 
@@ -438,37 +960,115 @@ public:
         erase_(tree_, index);
     }
 
-    long long getSum(const std::size_t& l, const std::size_t& r) {
-        return getSum_(tree_, l, r);
+    Value getSum(const std::size_t& l, const std::size_t& r) {
+        static_assert(has_<CTSum>, "getSum needs the CTSum feature");
+        return getAggregate_(tree_, l, r, [](const CTVertex* tree) { return tree->sum; });
+    }
+
+    Value getMin(const std::size_t& l, const std::size_t& r) {
+        static_assert(has_<CTMin>, "getMin needs the CTMin feature");
+        return getAggregate_(tree_, l, r, [](const CTVertex* tree) { return tree->minimum; });
+    }
+
+    Value getMax(const std::size_t& l, const std::size_t& r) {
+        static_assert(has_<CTMax>, "getMax needs the CTMax feature");
+        return getAggregate_(tree_, l, r, [](const CTVertex* tree) { return tree->maximum; });
+    }
+
+    Value getGcd(const std::size_t& l, const std::size_t& r) {
+        static_assert(has_<CTGcd>, "getGcd needs the CTGcd feature");
+        return getAggregate_(tree_, l, r, [](const CTVertex* tree) { return tree->gcd; });
     }
 
     void addOnSegment(const std::size_t& l, const std::size_t& r,
-                      const long long& add) {
-        addOnSegment_(tree_, l, r, add);
+                      const Value& add) {
+        static_assert(has_<CTAdd>, "addOnSegment needs the CTAdd feature");
+        doSomethingOnSegment(tree_, l, r, [this, &add](Link tree) {
+                                              applyAdd_(tree, add);
+                                          });
     }
 
     void assignOnSegment(const std::size_t& l, const std::size_t& r,
-                         const long long& assignedValue) {
-        assignOnSegment_(tree_, l, r, assignedValue);
+                         const Value& assignedValue) {
+        static_assert(has_<CTAssign>, "assignOnSegment needs the CTAssign feature");
+        doSomethingOnSegment(tree_, l, r, [this, &assignedValue](Link tree) {
+                                              applyAssign_(tree, assignedValue);
+                                          });
     }
 
     void reverse(const std::size_t& l, const std::size_t& r) {
-        reverse_(tree_, l, r);
+        static_assert(has_<CTReverse>, "reverse needs the CTReverse feature");
+        doSomethingOnSegment(tree_, l, r, [this](Link tree) {
+                                              applyReverse_(tree);
+                                          });
     }
 
     void nextPermutation(const std::size_t& l, const std::size_t& r) {
-        nextPermutation_(tree_, l, r);
+        static_assert(has_<CTMonotoneRuns> && has_<CTReverse>,
+                      "nextPermutation needs the CTMonotoneRuns and CTReverse features");
+        doSomethingOnSegment(tree_, l, r, [this](Link& tree) {
+                    followingPermutation_(tree, [](const CTVertex* tree) { return tree->rightDecreasingSequenceSize; },
+                                          std::greater<Value>());
+                    });
     }
 
     void prevPermutation(const std::size_t& l, const std::size_t& r) {
-        prevPermutation_(tree_, l, r);
+        static_assert(has_<CTMonotoneRuns> && has_<CTReverse>,
+                      "prevPermutation needs the CTMonotoneRuns and CTReverse features");
+        doSomethingOnSegment(tree_, l, r, [this](Link& tree) {
+                    followingPermutation_(tree, [](const CTVertex* tree) { return tree->rightIncreasingSequenceSize; },
+                                          std::less<Value>());
+                    });
+    }
+
+    // Set operations for trees whose values are sorted and distinct. The
+    // other tree is consumed; pass it with std::move to avoid a copy. Both
+    // halves of every split run in parallel on up to threads threads.
+    // Vertices move from one tree to the other, which needs pointer links.
+    void setUnion(CartesianTree another, unsigned threads = std::thread::hardware_concurrency()) {
+        static_assert(!has_<CTIndexPool>, "setUnion cannot be used with CTIndexPool");
+        tree_ = union_(tree_, another.tree_, threads);
+        another.tree_ = Link();
+    }
+
+    void setIntersection(CartesianTree another, unsigned threads = std::thread::hardware_concurrency()) {
+        static_assert(!has_<CTIndexPool>, "setIntersection cannot be used with CTIndexPool");
+        tree_ = intersection_(tree_, another.tree_, threads);
+        another.tree_ = Link();
+    }
+
+    void setDifference(CartesianTree another, unsigned threads = std::thread::hardware_concurrency()) {
+        static_assert(!has_<CTIndexPool>, "setDifference cannot be used with CTIndexPool");
+        tree_ = difference_(tree_, another.tree_, threads);
+        another.tree_ = Link();
+    }
+
+    // Adds a sorted batch of distinct values to a sorted tree: the batch is
+    // built in linear time and united with the tree.
+    template <class ForwardIterator>
+    void insertSorted(ForwardIterator first, ForwardIterator last,
+                      unsigned threads = std::thread::hardware_concurrency()) {
+        setUnion(CartesianTree(first, last), threads);
+    }
+
+    // Number of values less than value in a sorted tree.
+    std::size_t lowerBound(const Value& value) {
+        own_(tree_);
+        return extremeVertexValue_(tree_, value, std::less<Value>());
     }
 
     void inOrder() {
+        own_(tree_);
         inOrder_(tree_);
     }
 
     void read() {
-        read_(tree_);
+        read_();
     }
 };
+
+template <typename Value>
+class CartesianTree<Value> : public CartesianTree<Value, CTSum, CTMonotoneRuns, CTAdd, CTAssign, CTReverse> {
+public:
+    using CartesianTree<Value, CTSum, CTMonotoneRuns, CTAdd, CTAssign, CTReverse>::CartesianTree;
+};
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "CartesianTree.h"
+
+
+// A random mix of insertions, erasures and range operations on a tree that
+// grows to about a third of the number of operations.
+template <class Tree>
+double randomOperations(int operations, unsigned seed) {
+    std::mt19937 random(seed);
+    Tree tree;
+    tree.reserve(operations);
+    long long checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < operations; ++i) {
+        std::size_t size = tree.size();
+        unsigned operation = random() % 10;
+        if (operation < 4 || size < 2) {
+            tree.insert(random() % (size + 1), random() % 1000);
+            continue;
+        }
+        if (operation < 6) {
+            tree.erase(random() % size);
+            continue;
+        }
+        std::size_t l = random() % size, r = random() % size;
+        if (l > r)
+            std::swap(l, r);
+        if (operation < 8)
+            checksum += tree.getSum(l, r);
+        else if (operation < 9)
+            tree.addOnSegment(l, r, 1);
+        else
+            tree.reverse(l, r);
+    }
+    double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    volatile long long sink = checksum;
+    (void)sink;
+    return time;
+}
+
+void benchmarkIndexPool(int operations = 10000000) {
+    std::cout << "\n" << operations << " random insert/erase/range operations:\n"
+              << "***********************\n";
+    double pointers = randomOperations<CartesianTree<long long, CTSum, CTAdd, CTReverse>>(operations, 1);
+    double indices = randomOperations<CartesianTree<long long, CTSum, CTAdd, CTReverse, CTIndexPool>>(operations, 1);
+    std::cout << "pointer links:     time = " << pointers << " s\n"
+              << "32-bit index pool: time = " << indices << " s, speedup = " << pointers / indices << "\n";
+}
+
+// Loads size values into a tree, once by appending them one at a time and
+// once with the linear-time build.
+// 10^8 values take about 4 GB, so that size has to be asked for.
+void benchmarkBuild(std::size_t size = 10000000) {
+    typedef CartesianTree<long long, CTSum, CTIndexPool> Tree;
+    std::cout << "\nLoading " << size << " values:\n"
+              << "***********************\n";
+    std::mt19937 random(1);
+    std::vector<long long> values(size);
+    for (long long& value : values)
+        value = random() % 1000;
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        Tree tree;
+        tree.reserve(size);
+        for (long long value : values)
+            tree.insert(tree.size(), value);
+    }
+    double appending = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    double building;
+    {
+        Tree tree(values.begin(), values.end());
+        building = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        volatile long long sink = tree.getSum(0, size - 1);
+        (void)sink;
+    }
+    std::cout << "appending: time = " << appending << " s\n"
+              << "build:     time = " << building << " s, speedup = " << appending / building
+              << ", " << size / building / 1e6 << " M values/s\n";
+}
+
+// Range updates on a tree of size values with a snapshot taken every
+// snapshotEvery updates; the snapshots are dropped right away.
+template <class Tree>
+double updatesWithSnapshots(std::size_t size, int updates, int snapshotEvery) {
+    std::mt19937 random(1);
+    std::vector<long long> values(size, 1);
+    Tree tree(values.begin(), values.end());
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < updates; ++i) {
+        std::size_t l = random() % size, r = random() % size;
+        if (l > r)
+            std::swap(l, r);
+        if (i % 2)
+            tree.addOnSegment(l, r, 1);
+        else
+            tree.reverse(l, r);
+        if (i % snapshotEvery == 0)
+            Tree snapshot(tree);
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// One writer publishes a new version every publishEvery updates, readers
+// keep taking the latest one and summing over random segments of it.
+void publishedVersions(std::size_t size, int updates, int publishEvery, int readers) {
+    typedef CartesianTree<long long, CTSum, CTAdd, CTReverse, CTPersistent> Tree;
+    std::mt19937 random(1);
+    std::vector<long long> values(size, 1);
+    Tree tree(values.begin(), values.end());
+    std::mutex latestMutex;
+    Tree latest(tree);
+    bool done = false;
+    std::vector<long long> queries(readers);
+    std::vector<std::thread> threads;
+    for (int k = 0; k < readers; ++k)
+        threads.emplace_back([&, k]() {
+            std::mt19937 random(k + 2);
+            while (true) {
+                Tree version;
+                {
+                    std::lock_guard<std::mutex> lock(latestMutex);
+                    if (done)
+                        break;
+                    version = latest;
+                }
+                for (int i = 0; i < 100; ++i) {
+                    std::size_t l = random() % size, r = random() % size;
+                    version.getSum(std::min(l, r), std::max(l, r));
+                }
+                queries[k] += 100;
+            }
+        });
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < updates; ++i) {
+        std::size_t l = random() % size, r = random() % size;
+        if (l > r)
+            std::swap(l, r);
+        tree.addOnSegment(l, r, 1);
+        if (i % publishEvery == 0) {
+            Tree version(tree);
+            std::lock_guard<std::mutex> lock(latestMutex);
+            latest = version;
+        }
+    }
+    double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    {
+        std::lock_guard<std::mutex> lock(latestMutex);
+        done = true;
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    long long total = 0;
+    for (long long count : queries)
+        total += count;
+    std::cout << readers << " readers: writer time = " << time << " s, reader queries = " << total << "\n";
+}
+
+void benchmarkPersistentSnapshots(std::size_t size = 1000000, int updates = 200000, int snapshotEvery = 1000) {
+    std::cout << "\n" << updates << " range updates on " << size << " values, snapshot every "
+              << snapshotEvery << ":\n"
+              << "***********************\n";
+    double copies = updatesWithSnapshots<CartesianTree<long long, CTSum, CTAdd, CTReverse>>(size, updates, snapshotEvery);
+    double versions = updatesWithSnapshots<CartesianTree<long long, CTSum, CTAdd, CTReverse, CTPersistent>>(size, updates, snapshotEvery);
+    std::cout << "deep copies:         time = " << copies << " s\n"
+              << "persistent versions: time = " << versions << " s, speedup = " << copies / versions << "\n";
+    publishedVersions(size, updates, snapshotEvery, 0);
+    publishedVersions(size, updates, snapshotEvery, 2);
+}
+
+// Unites two sorted trees of size / 2 distinct values each, once by
+// inserting the second one value by value and once with setUnion on 1 and
+// on all hardware threads.
+void benchmarkSetUnion(std::size_t size = 10000000) {
+    typedef CartesianTree<long long, CTSum> Tree;
+    std::cout << "\nUnion of two sorted trees with " << size << " values in total:\n"
+              << "***********************\n";
+    std::mt19937 random(1);
+    std::vector<long long> first, second;
+    for (std::size_t i = 0; i < size; ++i)
+        (random() % 2 ? first : second).push_back(i);
+
+    double inserts;
+    {
+        Tree tree(first.begin(), first.end());
+        auto start = std::chrono::steady_clock::now();
+        for (long long value : second)
+            tree.insert(tree.lowerBound(value), value);
+        inserts = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    std::cout << "single inserts: time = " << inserts << " s\n";
+
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned count : {1u, threads}) {
+        Tree tree(first.begin(), first.end());
+        Tree another(second.begin(), second.end());
+        auto start = std::chrono::steady_clock::now();
+        tree.setUnion(std::move(another), count);
+        double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "setUnion, " << count << " threads: time = " << time
+                  << " s, speedup = " << inserts / time << "\n";
+    }
+}
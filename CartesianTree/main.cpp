@@ -0,0 +1,11 @@
+#include "benchmark.h"
+
+int main() {
+
+    benchmarkIndexPool();
+    benchmarkBuild();
+    benchmarkPersistentSnapshots();
+    benchmarkSetUnion();
+
+    return 0;
+}
@@ -0,0 +1,327 @@
+#pragma once
+
+#include "CartesianTree.h"
+#include <algorithm>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+
+
+// The tree only prints itself, so its contents are read back from inOrder().
+template <class Tree>
+std::vector<long long> contents(Tree& tree) {
+    std::stringstream stream;
+    std::streambuf* old = std::cout.rdbuf(stream.rdbuf());
+    tree.inOrder();
+    std::cout.rdbuf(old);
+    std::vector<long long> values;
+    long long value;
+    while (stream >> value)
+        values.push_back(value);
+    return values;
+}
+
+// Random operations of the full feature set, mirrored on a plain vector.
+template <class Tree>
+void randomSequenceOperations(unsigned seed, int operations) {
+    std::mt19937 random(seed);
+    Tree tree;
+    std::vector<long long> model;
+    for (int i = 0; i < operations; ++i) {
+        std::size_t size = model.size();
+        unsigned operation = random() % 9;
+        if (operation == 0 || size < 2) {
+            std::size_t index = random() % (size + 1);
+            long long value = random() % 10;
+            tree.insert(index, value);
+            model.insert(model.begin() + index, value);
+            continue;
+        }
+        std::size_t l = random() % size, r = random() % size;
+        if (l > r)
+            std::swap(l, r);
+        if (operation >= 6 && r - l > 12)
+            r = l + random() % 12;
+        switch (operation) {
+            case 1:
+                tree.erase(l);
+                model.erase(model.begin() + l);
+                break;
+            case 2:
+                ASSERT_EQ(tree.getSum(l, r), std::accumulate(model.begin() + l, model.begin() + r + 1, 0LL));
+                break;
+            case 3: {
+                long long add = (long long)(random() % 7) - 3;
+                tree.addOnSegment(l, r, add);
+                for (std::size_t k = l; k <= r; ++k)
+                    model[k] += add;
+                break;
+            }
+            case 4: {
+                long long value = random() % 5;
+                tree.assignOnSegment(l, r, value);
+                std::fill(model.begin() + l, model.begin() + r + 1, value);
+                break;
+            }
+            case 5:
+                tree.reverse(l, r);
+                std::reverse(model.begin() + l, model.begin() + r + 1);
+                break;
+            case 6:
+            case 7:
+                tree.nextPermutation(l, r);
+                std::next_permutation(model.begin() + l, model.begin() + r + 1);
+                break;
+            default:
+                tree.prevPermutation(l, r);
+                std::prev_permutation(model.begin() + l, model.begin() + r + 1);
+        }
+        if (i % 1000 == 0) {
+            ASSERT_EQ(contents(tree), model);
+            Tree copy(tree);
+            ASSERT_EQ(contents(copy), model);
+            copy = tree;
+            ASSERT_EQ(copy.size(), model.size());
+        }
+    }
+    EXPECT_EQ(contents(tree), model);
+}
+
+TEST(CartesianTreeTest, RandomOperationsMatchVector) {
+    randomSequenceOperations<CartesianTree<>>(1, 100000);
+}
+
+template <class Tree>
+void randomMinMaxGcd(unsigned seed, int operations) {
+    std::mt19937 random(seed);
+    Tree tree;
+    std::vector<int> model;
+    for (int i = 0; i < operations; ++i) {
+        std::size_t size = model.size();
+        unsigned operation = random() % 6;
+        if (operation == 0 || size < 2) {
+            std::size_t index = random() % (size + 1);
+            int value = int(random() % 100) - 20;
+            tree.insert(index, value);
+            model.insert(model.begin() + index, value);
+            continue;
+        }
+        std::size_t l = random() % size, r = random() % size;
+        if (l > r)
+            std::swap(l, r);
+        switch (operation) {
+            case 1:
+                tree.erase(l);
+                model.erase(model.begin() + l);
+                break;
+            case 2:
+                ASSERT_EQ(tree.getMin(l, r), *std::min_element(model.begin() + l, model.begin() + r + 1));
+                ASSERT_EQ(tree.getMax(l, r), *std::max_element(model.begin() + l, model.begin() + r + 1));
+                break;
+            case 3: {
+                int gcd = 0;
+                for (std::size_t k = l; k <= r; ++k)
+                    gcd = std::gcd(gcd, model[k]);
+                ASSERT_EQ(tree.getGcd(l, r), gcd);
+                break;
+            }
+            case 4: {
+                int value = int(random() % 4) * 6;
+                tree.assignOnSegment(l, r, value);
+                std::fill(model.begin() + l, model.begin() + r + 1, value);
+                break;
+            }
+            default:
+                tree.reverse(l, r);
+                std::reverse(model.begin() + l, model.begin() + r + 1);
+        }
+    }
+}
+
+TEST(CartesianTreeTest, RandomOperationsOnIndexPool) {
+    randomSequenceOperations<CartesianTree<long long, CTSum, CTMonotoneRuns, CTAdd, CTAssign, CTReverse,
+                                           CTIndexPool>>(2, 100000);
+}
+
+TEST(CartesianTreeTest, MinMaxAndGcd) {
+    randomMinMaxGcd<CartesianTree<int, CTMin, CTMax, CTGcd, CTAssign, CTReverse>>(4, 50000);
+    randomMinMaxGcd<CartesianTree<int, CTIndexPool, CTMin, CTMax, CTGcd, CTAssign, CTReverse>>(5, 50000);
+}
+
+TEST(CartesianTreeTest, BuildFromRange) {
+    std::mt19937 random(6);
+    for (int round = 0; round < 20; ++round) {
+        std::vector<long long> values(random() % 3000);
+        for (long long& value : values)
+            value = random() % 10;
+        CartesianTree<> tree(values.begin(), values.end());
+        ASSERT_EQ(tree.size(), values.size());
+        ASSERT_EQ(contents(tree), values);
+        if (!values.empty()) {
+            ASSERT_EQ(tree.getSum(0, values.size() - 1), std::accumulate(values.begin(), values.end(), 0LL));
+        }
+
+        CartesianTree<long long, CTSum, CTMonotoneRuns, CTAdd, CTAssign, CTReverse, CTIndexPool> pooled;
+        pooled.build(values);
+        pooled.insert(0, 5);
+        values.insert(values.begin(), 5);
+        ASSERT_EQ(contents(pooled), values);
+    }
+}
+
+TEST(CartesianTreeTest, RandomOperationsOnPersistentTree) {
+    randomSequenceOperations<CartesianTree<long long, CTSum, CTMonotoneRuns, CTAdd, CTAssign, CTReverse,
+                                           CTPersistent>>(3, 100000);
+}
+
+TEST(CartesianTreeTest, PersistentVersionsStayFrozen) {
+    typedef CartesianTree<long long, CTSum, CTAdd, CTAssign, CTReverse, CTPersistent> Tree;
+    std::mt19937 random(7);
+    std::vector<std::pair<Tree, std::vector<long long>>> versions;
+    Tree tree;
+    std::vector<long long> model;
+    for (int i = 0; i < 20000; ++i) {
+        std::size_t size = model.size();
+        if (size < 2 || random() % 4 == 0) {
+            std::size_t index = random() % (size + 1);
+            tree.insert(index, i % 10);
+            model.insert(model.begin() + index, i % 10);
+        }
+        else {
+            std::size_t l = random() % size, r = random() % size;
+            if (l > r)
+                std::swap(l, r);
+            if (random() % 2) {
+                tree.addOnSegment(l, r, 1);
+                for (std::size_t k = l; k <= r; ++k)
+                    ++model[k];
+            }
+            else {
+                tree.reverse(l, r);
+                std::reverse(model.begin() + l, model.begin() + r + 1);
+            }
+        }
+        if (i % 500 == 0)
+            versions.emplace_back(tree, model);
+    }
+    for (auto& version : versions) {
+        Tree reader(version.first);
+        ASSERT_EQ(contents(reader), version.second);
+        ASSERT_EQ(contents(version.first), version.second);
+    }
+}
+
+TEST(CartesianTreeTest, PersistentVersionsReadOnOtherThreads) {
+    typedef CartesianTree<long long, CTSum, CTAdd, CTReverse, CTPersistent> Tree;
+    const std::size_t size = 100000;
+    std::vector<long long> ones(size, 1);
+    Tree tree(ones.begin(), ones.end());
+    std::mutex latestMutex;
+    Tree latest(tree);
+    bool done = false;
+    std::vector<std::thread> readers;
+    for (int k = 0; k < 3; ++k)
+        readers.emplace_back([&]() {
+            while (true) {
+                Tree version;
+                {
+                    std::lock_guard<std::mutex> lock(latestMutex);
+                    if (done)
+                        break;
+                    version = latest;
+                }
+                long long sum = version.getSum(0, size - 1);
+                ASSERT_GE(sum, (long long)size);
+                ASSERT_EQ(version.getSum(0, size - 1), sum);
+            }
+        });
+    std::mt19937 random(8);
+    for (int i = 0; i < 5000; ++i) {
+        std::size_t l = random() % size, r = random() % size;
+        if (l > r)
+            std::swap(l, r);
+        if (i % 2)
+            tree.addOnSegment(l, r, 1);
+        else
+            tree.reverse(l, r);
+        if (i % 50 == 0) {
+            Tree version(tree);
+            std::lock_guard<std::mutex> lock(latestMutex);
+            latest = version;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(latestMutex);
+        done = true;
+    }
+    for (std::thread& reader : readers)
+        reader.join();
+}
+
+template <class Tree>
+void randomSetOperations(unsigned seed, unsigned threads, int rounds, int maxSize) {
+    std::mt19937 random(seed);
+    auto randomSet = [&random](int size, int range) {
+        std::set<long long> values;
+        for (int i = 0; i < size; ++i)
+            values.insert(random() % range);
+        return std::vector<long long>(values.begin(), values.end());
+    };
+    for (int round = 0; round < rounds; ++round) {
+        int range = 1 + random() % (3 * maxSize);
+        std::vector<long long> first = randomSet(random() % maxSize, range);
+        std::vector<long long> second = randomSet(random() % maxSize, range);
+        std::vector<long long> united, common, difference;
+        std::set_union(first.begin(), first.end(), second.begin(), second.end(), std::back_inserter(united));
+        std::set_intersection(first.begin(), first.end(), second.begin(), second.end(),
+                              std::back_inserter(common));
+        std::set_difference(first.begin(), first.end(), second.begin(), second.end(),
+                            std::back_inserter(difference));
+
+        Tree tree(first.begin(), first.end()), another(second.begin(), second.end());
+        tree.setUnion(std::move(another), threads);
+        ASSERT_EQ(contents(tree), united);
+
+        Tree intersected(first.begin(), first.end()), kept(second.begin(), second.end());
+        intersected.setIntersection(kept, threads);
+        ASSERT_EQ(contents(intersected), common);
+        ASSERT_EQ(contents(kept), second);
+
+        Tree subtracted(first.begin(), first.end());
+        subtracted.setDifference(Tree(second.begin(), second.end()), threads);
+        ASSERT_EQ(contents(subtracted), difference);
+
+        Tree bulk(first.begin(), first.end());
+        bulk.insertSorted(second.begin(), second.end(), threads);
+        ASSERT_EQ(contents(bulk), united);
+        for (std::size_t k = 0; k < united.size(); k += 97)
+            ASSERT_EQ(bulk.lowerBound(united[k]), k);
+    }
+}
+
+TEST(CartesianTreeTest, SetOperationsMatchStdAlgorithms) {
+    randomSetOperations<CartesianTree<>>(9, 1, 40, 3000);
+    randomSetOperations<CartesianTree<long long, CTSum, CTMin, CTAdd, CTPersistent>>(10, 1, 40, 3000);
+}
+
+TEST(CartesianTreeTest, ParallelSetOperations) {
+    randomSetOperations<CartesianTree<>>(11, 8, 2, 200000);
+    typedef CartesianTree<long long, CTSum, CTPersistent> Tree;
+    std::vector<long long> evens(200000), thirds(200000), united;
+    for (std::size_t i = 0; i < evens.size(); ++i) {
+        evens[i] = 2 * i;
+        thirds[i] = 3 * i;
+    }
+    std::set_union(evens.begin(), evens.end(), thirds.begin(), thirds.end(), std::back_inserter(united));
+    Tree tree(evens.begin(), evens.end()), another(thirds.begin(), thirds.end());
+    Tree kept(tree);
+    tree.setUnion(another, 4);
+    EXPECT_EQ(contents(tree), united);
+    EXPECT_EQ(contents(kept), evens);
+    EXPECT_EQ(contents(another), thirds);
+}
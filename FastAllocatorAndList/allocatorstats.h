@@ -0,0 +1,148 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+
+// Counters are only collected when FAST_ALLOCATOR_STATS is defined;
+// otherwise every record* hook is an empty inline function.
+struct AllocatorStats {
+    int chunkSize;
+    std::size_t allocations;
+    std::size_t deallocations;
+    std::size_t poolHits;
+    std::size_t fallbacks;
+    std::size_t liveChunks;
+    std::size_t peakLiveChunks;
+    std::size_t reservedBlocks;
+    std::size_t reservedChunks;
+    std::size_t freeChunks;
+
+    double fragmentation() const {
+        return reservedChunks ? double(freeChunks) / double(reservedChunks) : 0;
+    }
+};
+
+namespace _allocator_stats {
+    const int largeClass = 33;
+
+    inline int classIndex(std::size_t bytes) {
+        return bytes > 256 ? largeClass : bytes < 8 ? 1 : int((bytes + 7) / 8);
+    }
+
+#ifdef FAST_ALLOCATOR_STATS
+    struct Counters {
+        std::atomic<std::size_t> allocations{0};
+        std::atomic<std::size_t> deallocations{0};
+        std::atomic<std::size_t> poolHits{0};
+        std::atomic<std::size_t> fallbacks{0};
+        std::atomic<std::size_t> liveChunks{0};
+        std::atomic<std::size_t> peakLiveChunks{0};
+        std::atomic<std::size_t> reservedBlocks{0};
+        std::atomic<std::size_t> reservedChunks{0};
+    };
+
+    inline Counters* counters() {
+        static Counters counters[largeClass + 1];
+        return counters;
+    }
+
+    inline void recordAllocation(std::size_t bytes, bool pooled) {
+        Counters& c = counters()[classIndex(bytes)];
+        c.allocations.fetch_add(1, std::memory_order_relaxed);
+        if (!pooled) {
+            c.fallbacks.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        c.poolHits.fetch_add(1, std::memory_order_relaxed);
+        std::size_t live = c.liveChunks.fetch_add(1, std::memory_order_relaxed) + 1;
+        std::size_t peak = c.peakLiveChunks.load(std::memory_order_relaxed);
+        while (peak < live && !c.peakLiveChunks.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+    }
+
+    inline void recordDeallocation(std::size_t bytes, bool pooled) {
+        Counters& c = counters()[classIndex(bytes)];
+        c.deallocations.fetch_add(1, std::memory_order_relaxed);
+        if (pooled)
+            c.liveChunks.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    inline void recordBlock(int chunkSize, std::ptrdiff_t blocks, std::ptrdiff_t chunks) {
+        Counters& c = counters()[classIndex(chunkSize)];
+        c.reservedBlocks.fetch_add(blocks, std::memory_order_relaxed);
+        c.reservedChunks.fetch_add(chunks, std::memory_order_relaxed);
+    }
+#else
+    inline void recordAllocation(std::size_t, bool) {}
+
+    inline void recordDeallocation(std::size_t, bool) {}
+
+    inline void recordBlock(int, std::ptrdiff_t, std::ptrdiff_t) {}
+#endif
+}
+
+inline std::vector<AllocatorStats> allocatorStatsSnapshot() {
+    std::vector<AllocatorStats> snapshot;
+#ifdef FAST_ALLOCATOR_STATS
+    for (int i = 1; i <= _allocator_stats::largeClass; ++i) {
+        const _allocator_stats::Counters& c = _allocator_stats::counters()[i];
+        AllocatorStats stats;
+        stats.chunkSize = i == _allocator_stats::largeClass ? 0 : i * 8;
+        stats.allocations = c.allocations.load(std::memory_order_relaxed);
+        stats.deallocations = c.deallocations.load(std::memory_order_relaxed);
+        stats.poolHits = c.poolHits.load(std::memory_order_relaxed);
+        stats.fallbacks = c.fallbacks.load(std::memory_order_relaxed);
+        stats.liveChunks = c.liveChunks.load(std::memory_order_relaxed);
+        stats.peakLiveChunks = c.peakLiveChunks.load(std::memory_order_relaxed);
+        stats.reservedBlocks = c.reservedBlocks.load(std::memory_order_relaxed);
+        stats.reservedChunks = c.reservedChunks.load(std::memory_order_relaxed);
+        stats.freeChunks = stats.reservedChunks > stats.liveChunks ?
+                           stats.reservedChunks - stats.liveChunks : 0;
+        if (stats.allocations || stats.reservedBlocks)
+            snapshot.push_back(stats);
+    }
+#endif
+    return snapshot;
+}
+
+inline void dumpAllocatorStats(std::ostream& out) {
+    for (const AllocatorStats& stats : allocatorStatsSnapshot()) {
+        if (stats.chunkSize)
+            out << "size class " << stats.chunkSize << ":\n";
+        else
+            out << "large (> 256 bytes):\n";
+        out << "    allocations = " << stats.allocations
+            << ", deallocations = " << stats.deallocations << "\n"
+            << "    pool hits = " << stats.poolHits
+            << ", fallbacks = " << stats.fallbacks << "\n"
+            << "    live chunks = " << stats.liveChunks
+            << ", peak = " << stats.peakLiveChunks << "\n"
+            << "    blocks = " << stats.reservedBlocks
+            << ", reserved chunks = " << stats.reservedChunks
+            << ", free chunks = " << stats.freeChunks
+            << ", fragmentation = " << stats.fragmentation() << "\n";
+    }
+}
+
+inline void dumpAllocatorStatsJson(std::ostream& out) {
+    out << "[";
+    bool first = true;
+    for (const AllocatorStats& stats : allocatorStatsSnapshot()) {
+        out << (first ? "\n" : ",\n")
+            << "  {\"chunkSize\": " << stats.chunkSize
+            << ", \"allocations\": " << stats.allocations
+            << ", \"deallocations\": " << stats.deallocations
+            << ", \"poolHits\": " << stats.poolHits
+            << ", \"fallbacks\": " << stats.fallbacks
+            << ", \"liveChunks\": " << stats.liveChunks
+            << ", \"peakLiveChunks\": " << stats.peakLiveChunks
+            << ", \"reservedBlocks\": " << stats.reservedBlocks
+            << ", \"reservedChunks\": " << stats.reservedChunks
+            << ", \"freeChunks\": " << stats.freeChunks
+            << ", \"fragmentation\": " << stats.fragmentation() << "}";
+        first = false;
+    }
+    out << (first ? "]\n" : "\n]\n");
+}
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory_resource>
+#include <random>
+#include <thread>
+#include <vector>
+#include "list.h"
+#include "poolresource.h"
+#include "threadcachedpool.h"
+#include "unrolledlist.h"
+
+
+template <class Allocator>
+void allocationRoundTrips(int rounds, int batch) {
+    Allocator alloc;
+    std::vector<typename Allocator::value_type*> chunks(batch);
+    for (int r = 0; r < rounds; ++r) {
+        for (int i = 0; i < batch; ++i)
+            chunks[i] = alloc.allocate(1);
+        for (int i = 0; i < batch; ++i)
+            alloc.deallocate(chunks[i], 1);
+    }
+}
+
+template <class Allocator>
+double timeOnThreads(int threadsNumber, int rounds, int batch) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threadsNumber; ++i)
+        threads.emplace_back(allocationRoundTrips<Allocator>, rounds, batch);
+    for (auto& thread : threads)
+        thread.join();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void benchmarkThreadScaling(int maxThreads = 32, int rounds = 2000, int batch = 1000) {
+    typedef _list::Node<int> Node;
+    std::cout << "\nAllocation scaling, " << rounds << " x " << batch
+              << " allocations per thread:\n***********************\n";
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        double pooled = timeOnThreads<FastAllocator<Node, ThreadCachedPool>>(threads, rounds, batch);
+        double standard = timeOnThreads<std::allocator<Node>>(threads, rounds, batch);
+        double operations = double(threads) * rounds * batch;
+        std::cout << "threads = " << threads << ":\n"
+                  << "    ThreadCachedPool: time = " << pooled << " s, "
+                  << operations / pooled / 1e6 << " M allocations/s\n"
+                  << "    std::allocator:   time = " << standard << " s, "
+                  << operations / standard / 1e6 << " M allocations/s\n";
+    }
+}
+
+template <typename T>
+double pointerChasing(int size, int passes, _fixed_allocator::Backing backing) {
+    typedef _list::Node<T> Node;
+    const int chunkSize = _fast_allocator::sizeClass(sizeof(Node));
+    auto& pool = SingleThreadedPool::Instance<chunkSize>::pool;
+    pool.trim();
+    pool.setBacking(backing);
+    pool.setBlockChunks(1 << 20, 1 << 24);
+
+    FastAllocator<Node> alloc;
+    std::vector<Node*> nodes(size);
+    for (int i = 0; i < size; ++i)
+        nodes[i] = alloc.allocate(1);
+    std::shuffle(nodes.begin(), nodes.end(), std::mt19937(size));
+    for (int i = 0; i < size; ++i)
+        alloc.deallocate(nodes[i], 1);
+
+    double time;
+    {
+        List<T> list;
+        for (int i = 0; i < size; ++i)
+            list.push_back(T(i));
+        T sum = T();
+        auto start = std::chrono::steady_clock::now();
+        for (int pass = 0; pass < passes; ++pass)
+            for (Node* node = list.head(); node; node = node->next_)
+                sum += node->value_;
+        time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        volatile T sink = sum;
+        (void)sink;
+    }
+    pool.trim();
+    pool.setBacking(_fixed_allocator::Backing::heap);
+    return time;
+}
+
+void benchmarkHugePages(int size = 10000000, int passes = 5) {
+    std::cout << "\nPointer chasing over a shuffled List, n = " << size
+              << ", " << passes << " passes:\n***********************\n";
+    double heap = pointerChasing<int>(size, passes, _fixed_allocator::Backing::heap);
+    double thp = pointerChasing<int>(size, passes, _fixed_allocator::Backing::transparentHugePages);
+    double huge = pointerChasing<int>(size, passes, _fixed_allocator::Backing::hugePages);
+    double nodes = double(size) * passes;
+    std::cout << "heap:                   time = " << heap << " s, "
+              << heap / nodes * 1e9 << " ns/node\n"
+              << "transparent huge pages: time = " << thp << " s, "
+              << thp / nodes * 1e9 << " ns/node, speedup = " << heap / thp << "\n"
+              << "2 MB huge pages:        time = " << huge << " s, "
+              << huge / nodes * 1e9 << " ns/node, speedup = " << heap / huge << "\n";
+}
+
+double pmrWorkload(std::pmr::memory_resource* resource, int size) {
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::pmr::list<int> list(resource);
+        std::pmr::map<int, int> map(resource);
+        List<int, std::pmr::polymorphic_allocator<int>> ownList(resource);
+        for (int i = 0; i < size; ++i) {
+            list.push_back(i);
+            map.emplace(int(i * 2654435761u), i);
+            ownList.push_back(i);
+        }
+        auto it = list.begin();
+        while (it != list.end()) {
+            it = list.erase(it);
+            if (it != list.end())
+                ++it;
+        }
+        for (int i = 0; i < size; i += 2)
+            map.erase(int(i * 2654435761u));
+        for (int i = 0; i < size / 2; ++i) {
+            list.push_front(i);
+            map.emplace(int(i * 2654435761u), i);
+            ownList.pop_front();
+        }
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void benchmarkMemoryResources(int size = 1000000) {
+    std::cout << "\nstd::pmr::list, std::pmr::map and List, n = " << size
+              << ":\n***********************\n";
+    double fixedPool, standardPool, arena, newDelete;
+    {
+        FixedPoolResource resource;
+        fixedPool = pmrWorkload(&resource, size);
+    }
+    {
+        std::pmr::unsynchronized_pool_resource resource;
+        standardPool = pmrWorkload(&resource, size);
+    }
+    {
+        MonotonicArenaResource resource;
+        arena = pmrWorkload(&resource, size);
+    }
+    newDelete = pmrWorkload(std::pmr::new_delete_resource(), size);
+    std::cout << "FixedPoolResource:                  time = " << fixedPool << " s\n"
+              << "unsynchronized_pool_resource:       time = " << standardPool << " s\n"
+              << "MonotonicArenaResource:             time = " << arena << " s\n"
+              << "new_delete_resource:                time = " << newDelete << " s\n";
+}
+
+template <class Container>
+double traverseContainer(const Container& container, int passes) {
+    auto start = std::chrono::steady_clock::now();
+    long long sum = 0;
+    for (int pass = 0; pass < passes; ++pass)
+        for (const auto& value : container)
+            sum += value;
+    volatile long long sink = sum;
+    (void)sink;
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <class Container>
+double insertEverySecond(Container& container) {
+    auto start = std::chrono::steady_clock::now();
+    for (auto it = container.begin(); it != container.end(); ++it)
+        it = ++container.insert(it, 0);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double traverseList(const List<int>& list, int passes) {
+    auto start = std::chrono::steady_clock::now();
+    long long sum = 0;
+    for (int pass = 0; pass < passes; ++pass)
+        for (_list::Node<int>* node = list.head(); node; node = node->next_)
+            sum += node->value_;
+    volatile long long sink = sum;
+    (void)sink;
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double insertEverySecond(List<int>& list) {
+    auto start = std::chrono::steady_clock::now();
+    for (_list::Node<int>* node = list.head(); node; node = node->next_)
+        list.insert_before(node, 0);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void benchmarkUnrolledList(int size = 10000000, int passes = 10) {
+    std::cout << "\nList<int> vs UnrolledList<int> vs std::list<int>, n = " << size
+              << ":\n***********************\n";
+    List<int> list;
+    UnrolledList<int> unrolled;
+    std::list<int> standard;
+    for (int i = 0; i < size; ++i) {
+        list.push_back(i);
+        unrolled.push_back(i);
+        standard.push_back(i);
+    }
+    std::cout << "traversal, " << passes << " passes:\n"
+              << "    List:         time = " << traverseList(list, passes) << " s\n"
+              << "    UnrolledList: time = " << traverseContainer(unrolled, passes) << " s\n"
+              << "    std::list:    time = " << traverseContainer(standard, passes) << " s\n";
+    std::cout << "insertion before every element:\n"
+              << "    List:         time = " << insertEverySecond(list) << " s\n"
+              << "    UnrolledList: time = " << insertEverySecond(unrolled) << " s\n"
+              << "    std::list:    time = " << insertEverySecond(standard) << " s\n";
+}
+
+void benchmarkCompaction(int size = 10000000, int passes = 5) {
+    typedef _list::Node<int> Node;
+    std::cout << "\nList::compact() on a list scattered over the pool, n = " << size
+              << ":\n***********************\n";
+    FastAllocator<Node> alloc;
+    std::vector<Node*> nodes(size);
+    for (int i = 0; i < size; ++i)
+        nodes[i] = alloc.allocate(1);
+    std::shuffle(nodes.begin(), nodes.end(), std::mt19937(size));
+    for (int i = 0; i < size; ++i)
+        alloc.deallocate(nodes[i], 1);
+    std::vector<Node*>().swap(nodes);
+
+    List<int> list;
+    for (int i = 0; i < size; ++i)
+        list.push_back(i);
+    double fragmentation = list.fragmentation();
+    double before = traverseList(list, passes);
+    auto start = std::chrono::steady_clock::now();
+    list.compact();
+    double compaction = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double after = traverseList(list, passes);
+    std::cout << "before: fragmentation = " << fragmentation << ", " << passes
+              << " traversals: time = " << before << " s\n"
+              << "compact(): time = " << compaction << " s\n"
+              << "after:  fragmentation = " << list.fragmentation() << ", " << passes
+              << " traversals: time = " << after << " s, speedup = " << before / after << "\n";
+}
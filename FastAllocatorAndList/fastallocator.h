@@ -1,11 +1,49 @@
+#pragma once
+
 #include "fixedallocator.h"
 #include <iostream>
 
 
-template <typename T>
+namespace _fast_allocator {
+    const int maxPooledSize = 256;
+
+    constexpr int sizeClass(int size) {
+        return size < 8 ? 8 : (size + 7) / 8 * 8;
+    }
+}
+
+struct SingleThreadedPool {
+    template <int chunkSize>
+    struct Instance {
+        static FixedAllocator<chunkSize> pool;
+    };
+
+    template <int chunkSize>
+    static void* allocate() {
+        return Instance<chunkSize>::pool.allocateChunk();
+    }
+
+    template <int chunkSize>
+    static void deallocate(void* p) {
+        Instance<chunkSize>::pool.deallocateChunk(p);
+    }
+
+    template <int chunkSize>
+    static void allocateBatch(void** out, int n) {
+        Instance<chunkSize>::pool.allocateBatch(out, n);
+    }
+};
+
+template <int chunkSize>
+FixedAllocator<chunkSize> SingleThreadedPool::Instance<chunkSize>::pool;
+
+
+template <typename T, class Pool = SingleThreadedPool>
 class FastAllocator {
 private:
-    static FixedAllocator<24> fa24;
+    static const bool pooled_ = sizeof(T) <= _fast_allocator::maxPooledSize && alignof(T) <= 8;
+    static const int chunkSize_ = pooled_ ? _fast_allocator::sizeClass(sizeof(T))
+                                          : _fast_allocator::maxPooledSize;
 
 public:
     typedef T value_type;
@@ -17,8 +55,8 @@ public:
     typedef std::ptrdiff_t difference_type;
     typedef std::true_type propagate_on_container_move_assignment;
 
-    template <class U> 
-    struct rebind { typedef FastAllocator<U> other; };
+    template <class U>
+    struct rebind { typedef FastAllocator<U, Pool> other; };
 
     FastAllocator() {}
 
@@ -28,17 +66,33 @@ public:
 
     FastAllocator(FastAllocator&&) {}
 
+    template <class U>
+    FastAllocator(const FastAllocator<U, Pool>&) {}
+
     pointer allocate(const int& n) const {
-        int size = sizeof(T) * n;
-        if (size == 24)
-            return reinterpret_cast<pointer>(fa24.allocateChunk());
-        return reinterpret_cast<pointer>(::operator new(size));
+        _allocator_stats::recordAllocation(sizeof(T) * n, pooled_ && n == 1);
+        if (pooled_ && n == 1)
+            return reinterpret_cast<pointer>(Pool::template allocate<chunkSize_>());
+        return reinterpret_cast<pointer>(::operator new(sizeof(T) * n));
+    }
+
+    // Hands out n chunks that can be freed one by one with deallocate(p, 1).
+    // Pooled chunks come sorted by address, free ones first.
+    void allocate_batch(pointer* out, const int& n) const {
+        if (pooled_) {
+            for (int i = 0; i < n; ++i)
+                _allocator_stats::recordAllocation(sizeof(T), true);
+            Pool::template allocateBatch<chunkSize_>(reinterpret_cast<void**>(out), n);
+        }
+        else
+            for (int i = 0; i < n; ++i)
+                out[i] = allocate(1);
     }
 
     void deallocate(pointer p, const int& n) const {
-        int size = sizeof(T) * n;
-        if (size == 24)
-            fa24.deallocateChunk(p);
+        _allocator_stats::recordDeallocation(sizeof(T) * n, pooled_ && n == 1);
+        if (pooled_ && n == 1)
+            Pool::template deallocate<chunkSize_>(p);
         else
             ::operator delete(p);
     }
@@ -54,15 +108,12 @@ public:
     }
 };
 
-template<class T1, class T2>
-bool operator==(const FastAllocator<T1>& lhs, const FastAllocator<T2>& rhs) {
+template<class T1, class T2, class Pool>
+bool operator==(const FastAllocator<T1, Pool>& lhs, const FastAllocator<T2, Pool>& rhs) {
     return true;
 }
 
-template<class T1, class T2>
-bool operator!=(const FastAllocator<T1>& lhs, const FastAllocator<T2>& rhs) {
+template<class T1, class T2, class Pool>
+bool operator!=(const FastAllocator<T1, Pool>& lhs, const FastAllocator<T2, Pool>& rhs) {
     return false;
 }
-
-template <typename T>
-FixedAllocator<24> FastAllocator<T>::fa24;
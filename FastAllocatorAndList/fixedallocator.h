@@ -1,40 +1,242 @@
+#pragma once
+
+#include "allocatorstats.h"
 #include "stack.h"
+#include <algorithm>
+#include <map>
+#include <cstdint>
+#include <new>
+#include <vector>
+#include <sys/mman.h>
+
+
+namespace _fixed_allocator {
+    enum class Backing {
+        heap,
+        mmap,
+        transparentHugePages,
+        hugePages
+    };
+
+    const std::size_t hugePageSize = std::size_t(2) << 20;
+
+    struct Block {
+        std::size_t bytes;
+        unsigned chunks;
+        unsigned live;      // only meaningful inside trim()
+        Backing backing;    // what the block was actually mapped with
+        Backing requested;  // what setBacking() asked for at the time
+        bool decommitted;
+    };
 
+    inline std::size_t blockBytes(std::size_t bytes, Backing backing) {
+        if (backing == Backing::heap || backing == Backing::mmap)
+            return bytes;
+        return (bytes + hugePageSize - 1) / hugePageSize * hugePageSize;
+    }
+
+    inline void* mapAligned_(std::size_t bytes) {
+        void* p = ::mmap(nullptr, bytes + hugePageSize, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return nullptr;
+        char* begin = static_cast<char*>(p);
+        char* aligned = reinterpret_cast<char*>(
+                (reinterpret_cast<std::uintptr_t>(begin) + hugePageSize - 1) / hugePageSize * hugePageSize);
+        if (aligned != begin)
+            ::munmap(begin, aligned - begin);
+        if (aligned + bytes != begin + bytes + hugePageSize)
+            ::munmap(aligned + bytes, begin + hugePageSize - aligned);
+        return aligned;
+    }
+
+    // Huge page requests degrade to the next weaker backing when the kernel
+    // refuses them, and |backing| is updated to what was actually obtained.
+    inline void* allocateBlock(std::size_t bytes, Backing& backing) {
+        if (backing == Backing::heap)
+            return ::operator new(bytes);
+        void* p = MAP_FAILED;
+        if (backing == Backing::hugePages) {
+            p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p == MAP_FAILED)
+                backing = Backing::transparentHugePages;
+        }
+        if (backing == Backing::transparentHugePages) {
+            p = mapAligned_(bytes);
+            if (p && ::madvise(p, bytes, MADV_HUGEPAGE) == 0)
+                return p;
+            if (p)
+                ::munmap(p, bytes);
+            p = MAP_FAILED;
+            backing = Backing::mmap;
+        }
+        if (backing == Backing::mmap)
+            p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            throw std::bad_alloc();
+        return p;
+    }
+
+    inline void releaseBlock(void* p, std::size_t bytes, Backing backing) {
+        if (backing == Backing::heap)
+            ::operator delete(p);
+        else
+            ::munmap(p, bytes);
+    }
+}
 
 template <int chunkSize>
 class FixedAllocator {
 private:
-    mutable Stack allocated_, free_;
-    const unsigned allocated_size_ = 1000000;
-    mutable unsigned used_size_ = 1000000;
+    typedef _fixed_allocator::Block Block;
+    typedef _fixed_allocator::Backing Backing;
+
+    mutable Stack free_;
+    mutable std::map<char*, Block> blocks_;
+    mutable std::vector<char*> decommitted_;
+    mutable char* current_ = nullptr;
+    mutable Block* currentBlock_ = nullptr;
+    mutable unsigned used_size_ = 0;
+    mutable std::size_t reservedChunks_ = 0;
+    mutable Backing backing_ = Backing::heap;
+    mutable unsigned initialBlockChunks_ = 1024;
+    mutable unsigned maxBlockChunks_ = 1000000;
+
+    Block& blockOf_(void* p) const {
+        auto it = blocks_.upper_bound(static_cast<char*>(p));
+        return (--it)->second;
+    }
+
+    void startBlock_() const {
+        current_ = nullptr;
+        // Decommitted blocks are reused only for the backing they were
+        // mapped for, so setBacking() takes effect on the next block.
+        for (std::size_t i = 0; i < decommitted_.size(); ++i) {
+            Block& block = blocks_[decommitted_[i]];
+            if (block.requested != backing_)
+                continue;
+            current_ = decommitted_[i];
+            decommitted_.erase(decommitted_.begin() + i);
+            currentBlock_ = &block;
+            currentBlock_->decommitted = false;
+            break;
+        }
+        if (!current_) {
+            std::size_t wanted = reservedChunks_ < initialBlockChunks_ ? initialBlockChunks_ :
+                                 reservedChunks_ > maxBlockChunks_ ? maxBlockChunks_ : reservedChunks_;
+            Backing backing = backing_;
+            std::size_t bytes = _fixed_allocator::blockBytes(wanted * chunkSize, backing);
+            current_ = static_cast<char*>(_fixed_allocator::allocateBlock(bytes, backing));
+            currentBlock_ = &blocks_[current_];
+            *currentBlock_ = Block{bytes, static_cast<unsigned>(bytes / chunkSize), 0, backing, backing_, false};
+        }
+        reservedChunks_ += currentBlock_->chunks;
+        _allocator_stats::recordBlock(chunkSize, 1, currentBlock_->chunks);
+        used_size_ = 0;
+    }
 
 public:
     FixedAllocator() {}
 
     ~FixedAllocator() {
-        while (!allocated_.empty()) {
-            void* p = allocated_.top();
-            ::operator delete(p);
-            allocated_.pop();
+        for (auto& block : blocks_) {
+            if (!block.second.decommitted)
+                _allocator_stats::recordBlock(chunkSize, -1, -std::ptrdiff_t(block.second.chunks));
+            _fixed_allocator::releaseBlock(block.first, block.second.bytes, block.second.backing);
         }
     }
 
     FixedAllocator(const FixedAllocator& another) {}
 
+    void setBacking(Backing backing) const {
+        backing_ = backing;
+    }
+
+    void setBlockChunks(unsigned initialBlockChunks, unsigned maxBlockChunks) const {
+        initialBlockChunks_ = initialBlockChunks;
+        maxBlockChunks_ = maxBlockChunks;
+    }
+
+    // Chunks in the blocks this allocator currently holds, free or not.
+    std::size_t reservedChunks() const {
+        return reservedChunks_;
+    }
+
     void* allocateChunk() const {
         if (!free_.empty()) {
             void* ans = free_.top();
             free_.pop();
             return ans;
         }
-        if (used_size_ == allocated_size_) {
-            allocated_.push(::operator new(allocated_size_ * chunkSize));
-            used_size_ = 0;
+        if (!current_ || used_size_ == currentBlock_->chunks)
+            startBlock_();
+        return current_ + (used_size_++) * chunkSize;
+    }
+
+    // Hands out n chunks sorted by address. Freed chunks are reused before
+    // any new ones are carved, so the batch is a contiguous run whenever the
+    // free chunks are.
+    void allocateBatch(void** out, unsigned n) const {
+        unsigned taken = 0;
+        for (; taken < n && !free_.empty(); ++taken) {
+            out[taken] = free_.top();
+            free_.pop();
         }
-        return (char*)allocated_.top() + (used_size_++) * chunkSize;
+        for (; taken < n; ++taken) {
+            if (!current_ || used_size_ == currentBlock_->chunks)
+                startBlock_();
+            out[taken] = current_ + (used_size_++) * chunkSize;
+        }
+        std::sort(out, out + n);
     }
 
     void deallocateChunk(void* p) const {
         free_.push(p);
     }
-};
\ No newline at end of file
+
+    // Releases the blocks all of whose chunks are back in the free list.
+    // Live chunks are counted here rather than on every allocation, which
+    // keeps allocate and deallocate O(1). Only chunks returned through
+    // deallocateChunk count as free, so this is of no use under
+    // ThreadCachedPool, which recycles chunks through its own caches.
+    std::size_t trim() const {
+        for (auto& block : blocks_)
+            if (!block.second.decommitted)
+                block.second.live = block.first == current_ ? used_size_ : block.second.chunks;
+        for (int i = 0; i < free_.size; ++i)
+            --blockOf_(free_.buf[i]).live;
+
+        int kept = 0;
+        for (int i = 0; i < free_.size; ++i)
+            if (blockOf_(free_.buf[i]).live)
+                free_.buf[kept++] = free_.buf[i];
+        free_.size = kept;
+
+        std::size_t released = 0;
+        for (auto it = blocks_.begin(); it != blocks_.end();) {
+            Block& block = it->second;
+            if (block.live || block.decommitted) {
+                ++it;
+                continue;
+            }
+            released += block.bytes;
+            reservedChunks_ -= block.chunks;
+            _allocator_stats::recordBlock(chunkSize, -1, -std::ptrdiff_t(block.chunks));
+            if (it->first == current_)
+                current_ = nullptr;
+            if (block.backing != Backing::heap) {
+                ::madvise(it->first, block.bytes, MADV_DONTNEED);
+                block.decommitted = true;
+                decommitted_.push_back(it->first);
+                ++it;
+            }
+            else {
+                _fixed_allocator::releaseBlock(it->first, block.bytes, block.backing);
+                it = blocks_.erase(it);
+            }
+        }
+        return released;
+    }
+};
@@ -1,4 +1,9 @@
+#pragma once
+
 #include "fastallocator.h"
+#include <functional>
+#include <iterator>
+#include <memory>
 
 
 namespace _list {
@@ -8,12 +13,33 @@ namespace _list {
         Node* next_;
         T value_;
 
-        Node(const T& value) : prev_(nullptr), next_(nullptr), value_(value) {}
-
-        Node(T&& value) : prev_(nullptr), next_(nullptr), value_(std::move(value)) {}
+        template <class... Args>
+        explicit Node(Args&&... args) : prev_(nullptr), next_(nullptr), value_(std::forward<Args>(args)...) {}
 
         ~Node() {}
     };
+
+    template <class Alloc>
+    auto allocate_nodes(Alloc& alloc, typename std::allocator_traits<Alloc>::pointer* out, int n, int)
+            -> decltype(alloc.allocate_batch(out, n), void()) {
+        alloc.allocate_batch(out, n);
+    }
+
+    template <class Alloc>
+    void allocate_nodes(Alloc& alloc, typename std::allocator_traits<Alloc>::pointer* out, int n, long) {
+        for (int i = 0; i < n; ++i)
+            out[i] = alloc.allocate(1);
+    }
+
+    template <class InputIt>
+    int range_size(InputIt, InputIt, std::input_iterator_tag) {
+        return -1;
+    }
+
+    template <class ForwardIt>
+    int range_size(ForwardIt first, ForwardIt last, std::forward_iterator_tag) {
+        return int(std::distance(first, last));
+    }
 }
 
 template <typename T, class Allocator = FastAllocator<T>>
@@ -22,266 +48,648 @@ private:
     _list::Node<T> *head_, *tail_;
     int size_;
     Allocator alloc_;
-    typedef typename Allocator::template rebind<_list::Node<T> >::other NodeAllocator;
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<_list::Node<T> > NodeAllocator;
     NodeAllocator node_alloc_;
+    double auto_compact_threshold_ = 0;
+    int disorder_ = 0;
 
-    _list::Node<T>* insert_before_(_list::Node<T>* node, const T& value) {
-        _list::Node<T>* newNode = node_alloc_.allocate(1);
-        
-        node_alloc_.construct(newNode, value);
-        if (node->prev_) {
-            newNode->prev_ = node->prev_;
-            newNode->prev_->next_ = newNode;
-        }
-        newNode->next_ = node;
-        node->prev_ = newNode;
-        return newNode;
-    }
-
-    _list::Node<T>* insert_before_(_list::Node<T>* node, T&& value) {
-        _list::Node<T>* newNode = node_alloc_.allocate(1);
-        
-        node_alloc_.construct(newNode, std::move(value));
-        if (node->prev_) {
-            newNode->prev_ = node->prev_;
-            newNode->prev_->next_ = newNode;
+    void unlink_(_list::Node<T>* first, _list::Node<T>* last) {
+        if (first->prev_)
+            first->prev_->next_ = last->next_;
+        else
+            head_ = last->next_;
+        if (last->next_)
+            last->next_->prev_ = first->prev_;
+        else
+            tail_ = first->prev_;
+    }
+
+    void link_before_(_list::Node<T>* pos, _list::Node<T>* first, _list::Node<T>* last) {
+        _list::Node<T>* prev = pos ? pos->prev_ : tail_;
+        first->prev_ = prev;
+        last->next_ = pos;
+        if (prev)
+            prev->next_ = first;
+        else
+            head_ = first;
+        if (pos)
+            pos->prev_ = last;
+        else
+            tail_ = last;
+    }
+
+    template <class Compare>
+    static _list::Node<T>* merge_chains_(_list::Node<T>* first, _list::Node<T>* second, Compare& cmp) {
+        _list::Node<T>* result = nullptr;
+        _list::Node<T>** tail = &result;
+        while (first && second) {
+            if (cmp(second->value_, first->value_)) {
+                *tail = second;
+                second = second->next_;
+            }
+            else {
+                *tail = first;
+                first = first->next_;
+            }
+            tail = &(*tail)->next_;
         }
-        newNode->next_ = node;
-        node->prev_ = newNode;
-        return newNode;
+        *tail = first ? first : second;
+        return result;
     }
 
-    _list::Node<T>* insert_after_(_list::Node<T>* node, const T& value) {
-        if (node->next_)
-            return insert_before_(node->next_, value);
-        node->next_ = node_alloc_.allocate(1);
-        node_alloc_.construct(node->next_, value);
-        node->next_->prev_ = node;
-        return node->next_;
+    void note_disorder_(int count = 1) {
+        disorder_ += count;
     }
 
-    _list::Node<T>* insert_after_(_list::Node<T>* node, T&& value) {
-        if (node->next_)
-            return insert_before_(node->next_, value);
-        node->next_ = node_alloc_.allocate(1);
-        node_alloc_.construct(node->next_, std::move(value));
-        node->next_->prev_ = node;
-        return node->next_;
+    // Compacts the list if it is due and returns the node that now holds
+    // the value keep held (null stays null).
+    _list::Node<T>* maybe_compact_(_list::Node<T>* keep = nullptr) {
+        if (!(auto_compact_threshold_ > 0 && disorder_ > auto_compact_threshold_ * size_))
+            return keep;
+        int index = 0;
+        if (keep)
+            for (_list::Node<T>* node = head_; node != keep; node = node->next_)
+                ++index;
+        compact();
+        if (!keep)
+            return nullptr;
+        keep = head_;
+        while (index--)
+            keep = keep->next_;
+        return keep;
+    }
+
+    void relink_prev_(_list::Node<T>* chain) {
+        head_ = chain;
+        tail_ = nullptr;
+        for (_list::Node<T>* node = chain; node; node = node->next_) {
+            node->prev_ = tail_;
+            tail_ = node;
+        }
+    }
+
+    template <class... Args>
+    _list::Node<T>* emplace_before_(_list::Node<T>* pos, Args&&... args) {
+        _list::Node<T>* node = node_alloc_.allocate(1);
+        node_alloc_.construct(node, std::forward<Args>(args)...);
+        link_before_(pos, node, node);
+        ++size_;
+        return node;
     }
 
     void erase_(_list::Node<T>* node) {
-        if (node->prev_)
-            node->prev_->next_ = node->next_;
-        if (node->next_)
-            node->next_->prev_ = node->prev_;
+        unlink_(node, node);
         node_alloc_.destroy(node);
         node_alloc_.deallocate(node, 1);
-        node = nullptr;
+        --size_;
+    }
+
+    // Builds up to count nodes (or until make() returns false when count is
+    // -1) from batches of pooled chunks and links them in before pos.
+    template <class Make>
+    _list::Node<T>* insert_generated_(_list::Node<T>* pos, int count, Make make) {
+        const int batch = 1024;
+        _list::Node<T>* nodes[batch];
+        _list::Node<T> *first = nullptr, *last = nullptr;
+        int inserted = 0;
+        bool exhausted = false;
+        while (!exhausted && inserted != count) {
+            int wanted = count < 0 ? 64 : (count - inserted < batch ? count - inserted : batch);
+            _list::allocate_nodes(node_alloc_, nodes, wanted, 0);
+            int used = 0;
+            while (used < wanted && !(exhausted = !make(nodes[used]))) {
+                nodes[used]->prev_ = last;
+                if (last)
+                    last->next_ = nodes[used];
+                else
+                    first = nodes[used];
+                last = nodes[used++];
+            }
+            for (int i = used; i < wanted; ++i)
+                node_alloc_.deallocate(nodes[i], 1);
+            inserted += used;
+        }
+        if (!first)
+            return pos;
+        link_before_(pos, first, last);
+        size_ += inserted;
+        if (pos)
+            note_disorder_(inserted);
+        return first;
+    }
+
+    void copy_tail_(_list::Node<T>* source, int count) {
+        insert_generated_(nullptr, count, [&](_list::Node<T>* node) {
+            node_alloc_.construct(node, source->value_);
+            source = source->next_;
+            return true;
+        });
+    }
+
+    template <class InputIt>
+    _list::Node<T>* insert_range_(_list::Node<T>* pos, InputIt first, InputIt last) {
+        int count = _list::range_size(first, last,
+                typename std::iterator_traits<InputIt>::iterator_category());
+        return insert_generated_(pos, count, [&](_list::Node<T>* node) {
+            if (first == last)
+                return false;
+            node_alloc_.construct(node, *first);
+            ++first;
+            return true;
+        });
     }
 
 public:
+    template <class ValueType>
+    class ListIterator {
+    friend class List;
+    template <class> friend class ListIterator;
+    private:
+        _list::Node<T>* node_;
+        _list::Node<T>* const* tail_;
+
+        ListIterator(_list::Node<T>* node, _list::Node<T>* const* tail) : node_(node), tail_(tail) {}
+
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef ValueType* pointer;
+        typedef ValueType& reference;
+
+        ListIterator() : node_(nullptr), tail_(nullptr) {}
+
+        bool operator==(const ListIterator& another) const {
+            return node_ == another.node_;
+        }
+
+        bool operator!=(const ListIterator& another) const {
+            return node_ != another.node_;
+        }
+
+        ListIterator& operator++() {
+            node_ = node_->next_;
+            return *this;
+        }
+
+        ListIterator& operator--() {
+            node_ = node_ ? node_->prev_ : *tail_;
+            return *this;
+        }
+
+        ListIterator operator++(int) {
+            ListIterator tmp(*this);
+            ++*this;
+            return tmp;
+        }
+
+        ListIterator operator--(int) {
+            ListIterator tmp(*this);
+            --*this;
+            return tmp;
+        }
+
+        ValueType& operator*() const {
+            return node_->value_;
+        }
+
+        ValueType* operator->() const {
+            return &node_->value_;
+        }
+
+        _list::Node<T>* node() const {
+            return node_;
+        }
+
+        operator ListIterator<const T>() const {
+            return ListIterator<const T>(node_, tail_);
+        }
+    };
+
+    typedef ListIterator<T> iterator;
+    typedef ListIterator<const T> const_iterator;
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
     explicit List(const Allocator& alloc = Allocator())
-        : head_(nullptr), tail_(nullptr), size_(0), alloc_(alloc) {}
+        : head_(nullptr), tail_(nullptr), size_(0), alloc_(alloc), node_alloc_(alloc) {}
 
     List(int count, const T& value = T(), const Allocator& alloc = Allocator())
-        : size_(1), alloc_(alloc) {
-            head_ = (_list::Node<T>*)node_alloc_.allocate(1);
-            node_alloc_.construct(head_, value);
-            tail_ = head_;
-            while (size_ < count) {
-                tail_->next_ = (_list::Node<T>*)node_alloc_.allocate(1);
-                node_alloc_.construct(tail_->next_, value);
-                tail_->next_->prev_ = tail_;
-                tail_ = tail_->next_;
-                ++size_;
-            }
-        }
+        : head_(nullptr), tail_(nullptr), size_(0), alloc_(alloc), node_alloc_(alloc) {
+        insert(nullptr, count, value);
+    }
+
+    template <class InputIt, class = typename std::iterator_traits<InputIt>::iterator_category>
+    List(InputIt first, InputIt last, const Allocator& alloc = Allocator())
+        : head_(nullptr), tail_(nullptr), size_(0), alloc_(alloc), node_alloc_(alloc) {
+        insert_range_(nullptr, first, last);
+    }
 
     ~List() {
-        _list::Node<T>* tmp;
-        while(size_ > 0) {
-            tmp = tail_->prev_;
-            node_alloc_.destroy(tail_);
-            node_alloc_.deallocate(tail_, 1);
-            tail_ = tmp;
-            --size_;
-        }
+        clear();
     }
 
     int size() const {
         return size_;
     }
 
+    _list::Node<T>* head() const {
+        return head_;
+    }
+
+    iterator begin() {
+        return iterator(head_, &tail_);
+    }
+
+    iterator end() {
+        return iterator(nullptr, &tail_);
+    }
+
+    const_iterator begin() const {
+        return const_iterator(head_, &tail_);
+    }
+
+    const_iterator end() const {
+        return const_iterator(nullptr, &tail_);
+    }
+
+    const_iterator cbegin() const {
+        return begin();
+    }
+
+    const_iterator cend() const {
+        return end();
+    }
+
+    reverse_iterator rbegin() {
+        return reverse_iterator(end());
+    }
+
+    reverse_iterator rend() {
+        return reverse_iterator(begin());
+    }
+
+    const_reverse_iterator rbegin() const {
+        return const_reverse_iterator(end());
+    }
+
+    const_reverse_iterator rend() const {
+        return const_reverse_iterator(begin());
+    }
+
+    _list::Node<T>* tail() const {
+        return tail_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    T& front() {
+        return head_->value_;
+    }
+
+    const T& front() const {
+        return head_->value_;
+    }
+
+    T& back() {
+        return tail_->value_;
+    }
+
+    const T& back() const {
+        return tail_->value_;
+    }
+
     void push_back(const T& value) {
-        if (!tail_) {
-            head_ = (_list::Node<T>*)node_alloc_.allocate(1);
-            
-            node_alloc_.construct(head_, value);
-            tail_ = head_;
-        }
-        else {
-            tail_ = insert_after_(tail_, value);
-            if (size_ == 1)
-                head_->next_ = tail_;
-        }
-        ++size_;
+        emplace_before_(nullptr, value);
     }
 
     void push_back(T&& value) {
-        if (!tail_) {
-            head_ = (_list::Node<T>*)node_alloc_.allocate(1);
-            
-            node_alloc_.construct(head_, std::move(value));
-            tail_ = head_;
-        }
-        else {
-            tail_ = insert_after_(tail_, value);
-            if (size_ == 1)
-                head_->next_ = tail_;
-        }
-        ++size_;
+        emplace_before_(nullptr, std::move(value));
     }
 
-    List(const List& another) : size_(0), head_(nullptr), tail_(nullptr) {
-        _list::Node<T>* tmp = another.head_;
-        while (tmp) {
-            push_back(tmp->value_);
-            tmp = tmp->next_;
-        }
+    template <class... Args>
+    T& emplace_back(Args&&... args) {
+        return emplace_before_(nullptr, std::forward<Args>(args)...)->value_;
     }
 
-    List(List&& another) : size_(0), head_(nullptr), tail_(nullptr) {
-        _list::Node<T>* tmp = another.head_;
-        while (tmp) {
-            push_back(std::move(tmp->value_));
-            tmp = tmp->next_;
-        }
+    List(const List& another)
+        : head_(nullptr), tail_(nullptr), size_(0),
+          alloc_(std::allocator_traits<Allocator>::select_on_container_copy_construction(another.alloc_)),
+          node_alloc_(alloc_) {
+        copy_tail_(another.head_, another.size_);
+    }
+
+    List(List&& another)
+        : head_(another.head_), tail_(another.tail_), size_(another.size_),
+          alloc_(std::move(another.alloc_)), node_alloc_(std::move(another.node_alloc_)),
+          auto_compact_threshold_(another.auto_compact_threshold_), disorder_(another.disorder_) {
+        another.head_ = another.tail_ = nullptr;
+        another.size_ = 0;
+        another.disorder_ = 0;
     }
 
     List& operator=(const List& another) {
-        if (head_) {
-            node_alloc_.destroy(head_);
-            node_alloc_.deallocate(head_, 1);
+        if (this == &another)
+            return *this;
+        _list::Node<T>* source = another.head_;
+        _list::Node<T>* target = head_;
+        while (source && target) {
+            target->value_ = source->value_;
+            source = source->next_;
+            target = target->next_;
         }
-        if (tail_) {
-            node_alloc_.destroy(tail_);
-            node_alloc_.deallocate(tail_, 1);
+        while (size_ > another.size_)
+            pop_back();
+        copy_tail_(source, another.size_ - size_);
+        return *this;
+    }
+
+    List& operator=(List&& another) {
+        if (this == &another)
+            return *this;
+        clear();
+        auto_compact_threshold_ = another.auto_compact_threshold_;
+        if (node_alloc_ == another.node_alloc_) {
+            head_ = another.head_;
+            tail_ = another.tail_;
+            size_ = another.size_;
+            disorder_ = another.disorder_;
+            another.head_ = another.tail_ = nullptr;
+            another.size_ = 0;
+            another.disorder_ = 0;
         }
-        _list::Node<T>* tmp = another.head_;
-        size_ = 0;
-        head_ = nullptr;
-        tail_ = nullptr;
-        while (tmp) {
-            push_back(tmp->value_);
-            tmp = tmp->next_;
+        else {
+            for (_list::Node<T>* node = another.head_; node; node = node->next_)
+                emplace_before_(nullptr, std::move(node->value_));
+            another.clear();
         }
         return *this;
     }
 
-    List& operator=(List&& another) {
-        if (head_) {
+    void clear() {
+        _list::Node<T>* tmp;
+        while (head_) {
+            tmp = head_->next_;
             node_alloc_.destroy(head_);
             node_alloc_.deallocate(head_, 1);
+            head_ = tmp;
         }
-        if (tail_) {
-            node_alloc_.destroy(tail_);
-            node_alloc_.deallocate(tail_, 1);
-        }
-        _list::Node<T>* tmp = another.head_;
-        size_ = 0;
-        head_ = nullptr;
         tail_ = nullptr;
-        while (tmp) {
-            push_back(std::move(tmp->value_));
-            tmp = tmp->next_;
-        }
-        return *this;
+        size_ = 0;
+        disorder_ = 0;
     }
 
     void push_front(const T& value) {
-        if (!head_) {
-            head_ = (_list::Node<T>*)node_alloc_.allocate(1);
-            
-            node_alloc_.construct(head_, value);
-            tail_ = head_;
-        }
-        else {
-            head_ = insert_before_(head_, value);
-            if (size_ == 1)
-                tail_->prev_ = head_;
-        }
-        ++size_;
+        emplace_before_(head_, value);
     }
 
     void push_front(T&& value) {
-        if (!head_) {
-            head_ = (_list::Node<T>*)node_alloc_.allocate(1);
-            
-            node_alloc_.construct(head_, std::move(value));
-            tail_ = head_;
-        }
-        else {
-            head_ = insert_before_(head_, value);
-            if (size_ == 1)
-                tail_->prev_ = head_;
-        }
-        ++size;
+        emplace_before_(head_, std::move(value));
+    }
+
+    template <class... Args>
+    T& emplace_front(Args&&... args) {
+        return emplace_before_(head_, std::forward<Args>(args)...)->value_;
     }
 
     void pop_back() {
-        if (!size_)
-            return;
-        if (!tail_->prev_) {
-            node_alloc_.destroy(tail_);
-            node_alloc_.deallocate(tail_, 1);
-            tail_ = head_ = nullptr;
-        }
-        else {
-            tail_ = tail_->prev_;
-            erase_(tail_->next_);
-            tail_->next_ = nullptr;
-        }
-        --size_;
+        if (size_)
+            erase_(tail_);
     }
 
     void pop_front() {
-        if (!size_)
-            return;
-        if (!head_->next_) {
-            node_alloc_.destroy(head_);
-            node_alloc_.deallocate(head_, 1);
-            head_ = tail_ = nullptr;
-        }
-        else {
-            head_ = head_->next_;
-            erase_(head_->prev_);
-            head_->prev_ = nullptr;
-        }
-        --size_;
+        if (size_)
+            erase_(head_);
     }
 
     _list::Node<T>* insert_before(_list::Node<T>* node, const T& value) {
-        ++size_;
-        return insert_before_(node, value);
+        note_disorder_();
+        return emplace_before_(node, value);
     }
 
     _list::Node<T>* insert_before(_list::Node<T>* node, T&& value) {
-        ++size_;
-        return insert_before_(node, value);
+        note_disorder_();
+        return emplace_before_(node, std::move(value));
     }
 
     _list::Node<T>* insert_after(_list::Node<T>* node, const T& value) {
-        ++size_;
-        return insert_after_(node, value);
+        note_disorder_();
+        return emplace_before_(node->next_, value);
     }
 
     _list::Node<T>* insert_after(_list::Node<T>* node, T&& value) {
-        ++size_;
-        return insert_after_(node, value);
+        note_disorder_();
+        return emplace_before_(node->next_, std::move(value));
+    }
+
+    template <class... Args>
+    iterator emplace(const_iterator pos, Args&&... args) {
+        if (pos.node_)
+            note_disorder_();
+        return iterator(emplace_before_(pos.node_, std::forward<Args>(args)...), &tail_);
+    }
+
+    iterator insert(const_iterator pos, const T& value) {
+        return emplace(pos, value);
+    }
+
+    iterator insert(const_iterator pos, T&& value) {
+        return emplace(pos, std::move(value));
+    }
+
+    iterator insert(const_iterator pos, int count, const T& value) {
+        return iterator(insert(pos.node_, count, value), &tail_);
+    }
+
+    template <class InputIt, class = typename std::iterator_traits<InputIt>::iterator_category>
+    iterator insert(const_iterator pos, InputIt first, InputIt last) {
+        return iterator(insert_range_(pos.node_, first, last), &tail_);
+    }
+
+    iterator erase(const_iterator pos) {
+        _list::Node<T>* next = pos.node_->next_;
+        erase_(pos.node_);
+        note_disorder_();
+        return iterator(maybe_compact_(next), &tail_);
+    }
+
+    _list::Node<T>* insert(_list::Node<T>* pos, int count, const T& value) {
+        if (count <= 0)
+            return pos;
+        return insert_generated_(pos, count, [&](_list::Node<T>* node) {
+            node_alloc_.construct(node, value);
+            return true;
+        });
+    }
+
+    template <class InputIt, class = typename std::iterator_traits<InputIt>::iterator_category>
+    _list::Node<T>* insert(_list::Node<T>* pos, InputIt first, InputIt last) {
+        return insert_range_(pos, first, last);
+    }
+
+    template <class InputIt, class = typename std::iterator_traits<InputIt>::iterator_category>
+    void assign(InputIt first, InputIt last) {
+        int assigned = 0;
+        for (_list::Node<T>* node = head_; node && first != last; node = node->next_, ++first, ++assigned)
+            node->value_ = *first;
+        if (first != last)
+            insert_range_(nullptr, first, last);
+        else
+            while (size_ > assigned)
+                pop_back();
+    }
+
+    void assign(int count, const T& value) {
+        _list::Node<T>* node = head_;
+        int assigned = 0;
+        for (; node && assigned < count; node = node->next_, ++assigned)
+            node->value_ = value;
+        if (assigned < count)
+            insert(nullptr, count - assigned, value);
+        else
+            while (size_ > count)
+                pop_back();
     }
 
     void erase(_list::Node<T>* node) {
-        --size_;
         erase_(node);
+        note_disorder_();
+        maybe_compact_();
+    }
+
+    // Moves the values into new nodes and frees the old ones, so every node
+    // handle is invalidated. All new nodes are taken before any old one is
+    // freed, in batches sorted by address, so traversal walks memory forwards.
+    // The freed chunks are what the next compaction takes first, so repeated
+    // compactions alternate between two sets of chunks instead of growing
+    // the pool.
+    void compact() {
+        const int batch = 1024;
+        _list::Node<T>* nodes[batch];
+        _list::Node<T>* old = head_;
+        _list::Node<T>* source = old;
+        int left = size_;
+        head_ = tail_ = nullptr;
+        while (source) {
+            int count = left < batch ? left : batch;
+            _list::allocate_nodes(node_alloc_, nodes, count, 0);
+            for (int i = 0; i < count; ++i) {
+                node_alloc_.construct(nodes[i], std::move(source->value_));
+                nodes[i]->prev_ = tail_;
+                if (tail_)
+                    tail_->next_ = nodes[i];
+                else
+                    head_ = nodes[i];
+                tail_ = nodes[i];
+                source = source->next_;
+            }
+            left -= count;
+        }
+        while (old) {
+            _list::Node<T>* next = old->next_;
+            node_alloc_.destroy(old);
+            node_alloc_.deallocate(old, 1);
+            old = next;
+        }
+        disorder_ = 0;
+    }
+
+    // Share of links that do not lead to the adjacent chunk in memory.
+    double fragmentation() const {
+        if (size_ < 2)
+            return 0;
+        int jumps = 0;
+        for (_list::Node<T>* node = head_; node->next_; node = node->next_)
+            if (node->next_ != node + 1)
+                ++jumps;
+        return double(jumps) / (size_ - 1);
+    }
+
+    // Once the number of middle insertions and erasures since the last
+    // compaction exceeds threshold * size(), erase() compacts the list.
+    // A threshold of 0 turns this off.
+    void set_auto_compact(double threshold) {
+        auto_compact_threshold_ = threshold;
+    }
+
+    // Nodes change owners without being reallocated, so both lists must
+    // use allocators that compare equal. A null pos means the end.
+    void splice(_list::Node<T>* pos, List& other) {
+        if (&other == this || !other.head_)
+            return;
+        note_disorder_();
+        _list::Node<T>* first = other.head_;
+        _list::Node<T>* last = other.tail_;
+        link_before_(pos, first, last);
+        size_ += other.size_;
+        other.head_ = other.tail_ = nullptr;
+        other.size_ = 0;
+    }
+
+    void splice(_list::Node<T>* pos, List& other, _list::Node<T>* node) {
+        if (node == pos || (pos && node->next_ == pos))
+            return;
+        note_disorder_();
+        other.unlink_(node, node);
+        --other.size_;
+        link_before_(pos, node, node);
+        ++size_;
+    }
+
+    void splice(_list::Node<T>* pos, List& other, _list::Node<T>* first,
+                _list::Node<T>* last, int count) {
+        if (first == last)
+            return;
+        note_disorder_();
+        _list::Node<T>* back = last ? last->prev_ : other.tail_;
+        other.unlink_(first, back);
+        other.size_ -= count;
+        link_before_(pos, first, back);
+        size_ += count;
+    }
+
+    void splice(_list::Node<T>* pos, List& other, _list::Node<T>* first, _list::Node<T>* last) {
+        int count = 0;
+        for (_list::Node<T>* node = first; node != last; node = node->next_)
+            ++count;
+        splice(pos, other, first, last, count);
+    }
+
+    template <class Compare = std::less<T>>
+    void merge(List& other, Compare cmp = Compare()) {
+        if (&other == this || !other.head_)
+            return;
+        note_disorder_(other.size_);
+        relink_prev_(merge_chains_(head_, other.head_, cmp));
+        size_ += other.size_;
+        other.head_ = other.tail_ = nullptr;
+        other.size_ = 0;
+    }
+
+    template <class Compare = std::less<T>>
+    void sort(Compare cmp = Compare()) {
+        if (size_ < 2)
+            return;
+        note_disorder_(size_);
+        _list::Node<T>* bins[64] = {};
+        _list::Node<T>* node = head_;
+        while (node) {
+            _list::Node<T>* carry = node;
+            node = node->next_;
+            carry->next_ = nullptr;
+            int i = 0;
+            for (; bins[i]; ++i) {
+                carry = merge_chains_(bins[i], carry, cmp);
+                bins[i] = nullptr;
+            }
+            bins[i] = carry;
+        }
+        _list::Node<T>* result = nullptr;
+        for (int i = 0; i < 64; ++i)
+            if (bins[i])
+                result = merge_chains_(bins[i], result, cmp);
+        relink_prev_(result);
     }
 };
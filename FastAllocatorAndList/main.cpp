@@ -0,0 +1,16 @@
+#include "benchmark.h"
+
+int main() {
+
+    benchmarkThreadScaling();
+
+    benchmarkHugePages();
+
+    benchmarkMemoryResources();
+
+    benchmarkUnrolledList();
+
+    benchmarkCompaction();
+
+    return 0;
+}
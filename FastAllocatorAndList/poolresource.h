@@ -0,0 +1,176 @@
+#pragma once
+
+#include "fastallocator.h"
+#include <memory>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+
+namespace _pool_resource {
+    const int classesNumber = _fast_allocator::maxPooledSize / 8;
+
+    struct PoolBase {
+        virtual ~PoolBase() {}
+        virtual void* allocate() = 0;
+        virtual void deallocate(void* p) = 0;
+        virtual void setBacking(_fixed_allocator::Backing backing) = 0;
+        virtual std::size_t trim() = 0;
+    };
+
+    template <int chunkSize>
+    struct Pool : PoolBase {
+        FixedAllocator<chunkSize> chunks;
+
+        void* allocate() override {
+            return chunks.allocateChunk();
+        }
+
+        void deallocate(void* p) override {
+            chunks.deallocateChunk(p);
+        }
+
+        void setBacking(_fixed_allocator::Backing backing) override {
+            chunks.setBacking(backing);
+        }
+
+        std::size_t trim() override {
+            return chunks.trim();
+        }
+    };
+}
+
+class FixedPoolResource : public std::pmr::memory_resource {
+private:
+    std::unique_ptr<_pool_resource::PoolBase> pools_[_pool_resource::classesNumber];
+    std::pmr::memory_resource* upstream_;
+
+    template <std::size_t... classes>
+    void makePools_(std::index_sequence<classes...>) {
+        int dummy[] = {(pools_[classes].reset(new _pool_resource::Pool<(classes + 1) * 8>()), 0)...};
+        (void)dummy;
+    }
+
+    static bool pooled_(std::size_t bytes, std::size_t alignment) {
+        return bytes <= std::size_t(_fast_allocator::maxPooledSize) && alignment <= 8;
+    }
+
+    static int index_(std::size_t bytes) {
+        return _fast_allocator::sizeClass(int(bytes)) / 8 - 1;
+    }
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        _allocator_stats::recordAllocation(bytes, pooled_(bytes, alignment));
+        if (pooled_(bytes, alignment))
+            return pools_[index_(bytes)]->allocate();
+        return upstream_->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+        _allocator_stats::recordDeallocation(bytes, pooled_(bytes, alignment));
+        if (pooled_(bytes, alignment))
+            pools_[index_(bytes)]->deallocate(p);
+        else
+            upstream_->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+public:
+    explicit FixedPoolResource(std::pmr::memory_resource* upstream = std::pmr::get_default_resource(),
+                               _fixed_allocator::Backing backing = _fixed_allocator::Backing::heap)
+        : upstream_(upstream) {
+        makePools_(std::make_index_sequence<_pool_resource::classesNumber>());
+        for (auto& pool : pools_)
+            pool->setBacking(backing);
+    }
+
+    FixedPoolResource(const FixedPoolResource&) = delete;
+
+    FixedPoolResource& operator=(const FixedPoolResource&) = delete;
+
+    std::pmr::memory_resource* upstream_resource() const {
+        return upstream_;
+    }
+
+    std::size_t trim() {
+        std::size_t released = 0;
+        for (auto& pool : pools_)
+            released += pool->trim();
+        return released;
+    }
+};
+
+
+class MonotonicArenaResource : public std::pmr::memory_resource {
+private:
+    struct ArenaBlock {
+        void* begin;
+        std::size_t bytes;
+        _fixed_allocator::Backing backing;
+    };
+
+    std::vector<ArenaBlock> blocks_;
+    char* current_;
+    std::size_t left_;
+    std::size_t nextBlockBytes_;
+    std::size_t maxBlockBytes_;
+    _fixed_allocator::Backing backing_;
+
+    void startBlock_(std::size_t bytes) {
+        std::size_t wanted = bytes > nextBlockBytes_ ? bytes : nextBlockBytes_;
+        if (nextBlockBytes_ < maxBlockBytes_)
+            nextBlockBytes_ *= 2;
+        _fixed_allocator::Backing backing = backing_;
+        wanted = _fixed_allocator::blockBytes(wanted, backing);
+        void* begin = _fixed_allocator::allocateBlock(wanted, backing);
+        blocks_.push_back(ArenaBlock{begin, wanted, backing});
+        current_ = static_cast<char*>(begin);
+        left_ = wanted;
+    }
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        void* p = current_;
+        if (!current_ || !std::align(alignment, bytes, p, left_)) {
+            startBlock_(bytes + alignment);
+            p = current_;
+            std::align(alignment, bytes, p, left_);
+        }
+        current_ = static_cast<char*>(p) + bytes;
+        left_ -= bytes;
+        return p;
+    }
+
+    void do_deallocate(void*, std::size_t, std::size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+public:
+    explicit MonotonicArenaResource(std::size_t initialBlockBytes = std::size_t(64) << 10,
+                                    _fixed_allocator::Backing backing = _fixed_allocator::Backing::heap,
+                                    std::size_t maxBlockBytes = std::size_t(64) << 20)
+        : current_(nullptr), left_(0), nextBlockBytes_(initialBlockBytes),
+          maxBlockBytes_(maxBlockBytes), backing_(backing) {}
+
+    MonotonicArenaResource(const MonotonicArenaResource&) = delete;
+
+    MonotonicArenaResource& operator=(const MonotonicArenaResource&) = delete;
+
+    ~MonotonicArenaResource() {
+        release();
+    }
+
+    void release() {
+        for (const ArenaBlock& block : blocks_)
+            _fixed_allocator::releaseBlock(block.begin, block.bytes, block.backing);
+        blocks_.clear();
+        current_ = nullptr;
+        left_ = 0;
+    }
+};
@@ -1,3 +1,5 @@
+#pragma once
+
 #include <cstring>
 
 
@@ -8,18 +10,16 @@ struct Stack {
     ~Stack() {
         ::delete[](buf);
     }
-    Stack() : size(0), capacity(100000000) {
+    explicit Stack(int initialCapacity = 1024) : size(0), capacity(initialCapacity) {
         buf = new void* [capacity];
     }
     void push(void* value) {
         buf[size++] = value;
         if (size == capacity) {
-            void** newBuf = new void*[capacity];
+            void** newBuf = new void*[capacity *= 2];
             memcpy(newBuf, buf, size * sizeof(void*));
-            ::operator delete[](buf);
-            buf = new void*[capacity *= 2];
-            memcpy(buf, newBuf, size * sizeof(void*));
-            ::operator delete[](newBuf);
+            ::delete[](buf);
+            buf = newBuf;
         }
     }
     void pop() {
@@ -32,4 +32,4 @@ struct Stack {
     bool empty() {
         return size == 0;
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,508 @@
+#pragma once
+
+#include "fastallocator.h"
+#include "threadcachedpool.h"
+#include "list.h"
+#include "unrolledlist.h"
+#include "poolresource.h"
+#include <algorithm>
+#include <iterator>
+#include <list>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "gtest/gtest.h"
+
+
+template <class Container, class Reference>
+void expectSame(const Container& container, const Reference& reference) {
+    ASSERT_EQ(container.size(), int(reference.size()));
+    EXPECT_TRUE(std::equal(container.begin(), container.end(), reference.begin(), reference.end()));
+}
+
+TEST(ThreadCachedPoolTest, ChunksFreedOnOtherThreads) {
+    typedef FastAllocator<std::pair<long long, long long>, ThreadCachedPool> Allocator;
+    Allocator allocator;
+    std::vector<std::pair<long long, long long>*> chunks(100000);
+    for (auto& chunk : chunks)
+        chunk = allocator.allocate(1);
+    std::vector<std::thread> threads;
+    for (int k = 0; k < 4; ++k)
+        threads.emplace_back([&chunks, k]() {
+            Allocator allocator;
+            for (std::size_t i = k; i < chunks.size(); i += 4) {
+                allocator.deallocate(chunks[i], 1);
+                auto* chunk = allocator.allocate(1);
+                chunk->first = chunk->second = k;
+                allocator.deallocate(chunk, 1);
+            }
+        });
+    for (std::thread& thread : threads)
+        thread.join();
+    std::vector<std::pair<long long, long long>*> again(100000);
+    for (auto& chunk : again)
+        chunk = allocator.allocate(1);
+    std::sort(again.begin(), again.end());
+    EXPECT_TRUE(std::adjacent_find(again.begin(), again.end()) == again.end());
+    for (auto* chunk : again)
+        allocator.deallocate(chunk, 1);
+}
+
+struct ChunkSource {
+    virtual ~ChunkSource() {}
+    virtual void* acquire() = 0;
+    virtual void release(void* p) = 0;
+};
+
+template <class T>
+struct PooledChunkSource : ChunkSource {
+    void* acquire() override {
+        return FastAllocator<T, ThreadCachedPool>().allocate(1);
+    }
+
+    void release(void* p) override {
+        FastAllocator<T, ThreadCachedPool>().deallocate(static_cast<T*>(p), 1);
+    }
+};
+
+// No other test in this unit may use the 136-byte size class.
+struct VtableOnlyChunk {
+    char bytes[136];
+};
+
+// GCC 12 failed with "redefinition of 'bool __tls_guard'" on a unit that
+// used one size class directly and reached another only through a virtual
+// function, whose instantiation is deferred to the end of the unit. That
+// this compiles is most of the test.
+TEST(ThreadCachedPoolTest, SizeClassReachedOnlyThroughVtable) {
+    FastAllocator<int, ThreadCachedPool> direct;
+    direct.deallocate(direct.allocate(1), 1);
+    ChunkSource* source = new PooledChunkSource<VtableOnlyChunk>;
+    void* chunk = source->acquire();
+    EXPECT_NE(chunk, nullptr);
+    source->release(chunk);
+    delete source;
+}
+
+TEST(FixedAllocatorTest, TrimReleasesOnlyFreeBlocks) {
+    FixedAllocator<24> allocator;
+    allocator.setBlockChunks(1024, 1024);
+    std::vector<void*> chunks;
+    for (int i = 0; i < 10 * 1024; ++i)
+        chunks.push_back(allocator.allocateChunk());
+    for (std::size_t i = 0; i < chunks.size(); i += 2)
+        allocator.deallocateChunk(chunks[i]);
+    EXPECT_EQ(allocator.trim(), 0u);
+    for (std::size_t i = 1; i < 5 * 1024; i += 2)
+        allocator.deallocateChunk(chunks[i]);
+    EXPECT_EQ(allocator.trim(), 5u * 1024 * 24);
+    for (int i = 0; i < 1024; ++i)
+        EXPECT_NE(allocator.allocateChunk(), nullptr);
+}
+
+TEST(PoolResourceTest, PmrListRoundTrip) {
+    FixedPoolResource resource;
+    std::pmr::list<int> list(&resource);
+    for (int i = 0; i < 10000; ++i)
+        list.push_back(i);
+    list.clear();
+    EXPECT_GT(resource.trim(), 0u);
+}
+
+TEST(ListTest, MovesAndCopyAssignment) {
+    List<int> list;
+    std::list<int> reference;
+    for (int i = 0; i < 1000; ++i) {
+        list.push_back(i);
+        reference.push_back(i);
+    }
+    List<int> moved(std::move(list));
+    EXPECT_TRUE(list.empty());
+    expectSame(moved, reference);
+
+    List<int> shorter, longer;
+    for (int i = 0; i < 10; ++i)
+        shorter.push_back(-i);
+    for (int i = 0; i < 3000; ++i)
+        longer.push_back(-i);
+    shorter = moved;
+    longer = moved;
+    expectSame(shorter, reference);
+    expectSame(longer, reference);
+    list = std::move(longer);
+    expectSame(list, reference);
+    EXPECT_TRUE(longer.empty());
+}
+
+TEST(ListTest, SpliceMergeAndSort) {
+    List<int> first, second;
+    std::list<int> reference;
+    for (int i = 0; i < 100; ++i) {
+        (i % 2 ? first : second).push_back(i);
+        reference.push_back(i);
+    }
+    first.merge(second);
+    EXPECT_TRUE(second.empty());
+    expectSame(first, reference);
+
+    second.splice(nullptr, first, first.head(), first.head()->next_->next_, 2);
+    EXPECT_EQ(second.size(), 2);
+    EXPECT_EQ(first.size(), 98);
+    EXPECT_EQ(*first.begin(), 2);
+
+    std::mt19937 random(1);
+    List<std::pair<int, int>> pairs;
+    std::list<std::pair<int, int>> referencePairs;
+    for (int i = 0; i < 5000; ++i) {
+        std::pair<int, int> value(random() % 50, i);
+        pairs.push_back(value);
+        referencePairs.push_back(value);
+    }
+    auto byKey = [](const std::pair<int, int>& a, const std::pair<int, int>& b) {
+        return a.first < b.first;
+    };
+    pairs.sort(byKey);
+    referencePairs.sort(byKey);
+    expectSame(pairs, referencePairs);
+}
+
+TEST(UnrolledListTest, RandomOperationsMatchStdList) {
+    std::mt19937 random(5);
+    UnrolledList<int, 8> list;
+    std::list<int> reference;
+    for (int i = 0; i < 5000; ++i) {
+        int value = int(random() % 1000);
+        std::size_t position = reference.empty() ? 0 : random() % reference.size();
+        auto it = std::next(list.begin(), position);
+        auto referenceIt = std::next(reference.begin(), position);
+        switch (reference.empty() ? random() % 3 : random() % 7) {
+            case 0:
+                list.push_back(value);
+                reference.push_back(value);
+                break;
+            case 1:
+                list.push_front(value);
+                reference.push_front(value);
+                break;
+            case 2: {
+                auto inserted = list.insert(it, value);
+                reference.insert(referenceIt, value);
+                ASSERT_EQ(*inserted, value);
+                break;
+            }
+            case 3:
+                list.pop_back();
+                reference.pop_back();
+                break;
+            case 4:
+                list.pop_front();
+                reference.pop_front();
+                break;
+            default: {
+                auto next = list.erase(it);
+                auto referenceNext = reference.erase(referenceIt);
+                ASSERT_EQ(next == list.end(), referenceNext == reference.end());
+                if (referenceNext != reference.end()) {
+                    ASSERT_EQ(*next, *referenceNext);
+                }
+            }
+        }
+        ASSERT_NO_FATAL_FAILURE(expectSame(list, reference));
+        if (!reference.empty()) {
+            const UnrolledList<int, 8>& constList = list;
+            ASSERT_EQ(constList.front(), reference.front());
+            ASSERT_EQ(constList.back(), reference.back());
+        }
+    }
+    std::vector<int> backwards(reference.rbegin(), reference.rend());
+    std::vector<int> walked;
+    for (auto it = list.end(); it != list.begin();)
+        walked.push_back(*--it);
+    EXPECT_EQ(walked, backwards);
+}
+
+TEST(UnrolledListTest, LargeElementsGetSingleElementNodes) {
+    struct Large {
+        char bytes[300];
+    };
+    static_assert(_unrolled_list::defaultCapacity<Large>() == 1, "a 300-byte element cannot share a pooled node");
+    static_assert(sizeof(_unrolled_list::Node<std::string, _unrolled_list::defaultCapacity<std::string>()>)
+                  <= _fast_allocator::maxPooledSize, "the default node fits the largest size class");
+    UnrolledList<std::string> list;
+    for (int i = 0; i < 100; ++i)
+        list.push_back(std::to_string(i));
+    UnrolledList<std::string>::const_iterator it = list.begin();
+    EXPECT_EQ(*it, "0");
+    EXPECT_EQ(list.back(), "99");
+}
+
+// Random pushes, pops, middle insertions and erasures, checked against
+// std::list after every step.
+template <class TestedList>
+void randomListOperations(unsigned seed, int operations, double autoCompact) {
+    std::mt19937 random(seed);
+    TestedList list;
+    list.set_auto_compact(autoCompact);
+    std::list<int> reference;
+    for (int i = 0; i < operations; ++i) {
+        int value = int(random() % 1000);
+        std::size_t position = reference.empty() ? 0 : random() % reference.size();
+        auto it = std::next(list.begin(), position);
+        auto referenceIt = std::next(reference.begin(), position);
+        switch (reference.empty() ? random() % 3 : random() % 9) {
+            case 0:
+                list.push_back(value);
+                reference.push_back(value);
+                break;
+            case 1:
+                list.push_front(value);
+                reference.push_front(value);
+                break;
+            case 2:
+                list.insert(it, value);
+                reference.insert(referenceIt, value);
+                break;
+            case 3:
+                list.pop_back();
+                reference.pop_back();
+                break;
+            case 4:
+                list.pop_front();
+                reference.pop_front();
+                break;
+            case 5: {
+                auto next = list.erase(it);
+                auto referenceNext = reference.erase(referenceIt);
+                ASSERT_EQ(next == list.end(), referenceNext == reference.end());
+                if (referenceNext != reference.end()) {
+                    ASSERT_EQ(*next, *referenceNext);
+                }
+                break;
+            }
+            case 6:
+                list.erase(list.head());
+                reference.pop_front();
+                break;
+            case 7:
+                list.insert(it, 3, value);
+                reference.insert(referenceIt, 3, value);
+                break;
+            default:
+                if (random() % 20 == 0) {
+                    list.sort();
+                    reference.sort();
+                }
+                else
+                    list.compact();
+        }
+        ASSERT_NO_FATAL_FAILURE(expectSame(list, reference));
+    }
+}
+
+TEST(ListTest, RandomOperationsWithAutoCompaction) {
+    randomListOperations<List<int>>(2, 3000, 0.25);
+}
+
+TEST(ListTest, MoveKeepsAutoCompaction) {
+    List<int> list;
+    list.set_auto_compact(0.1);
+    for (int i = 0; i < 1000; ++i)
+        list.push_back(i);
+    List<int> moved(std::move(list));
+    for (int i = 0; i < 200; ++i)
+        moved.insert(std::next(moved.begin(), 1 + i % 500), i);
+    // Compaction takes every new node before freeing an old one, so it is
+    // the only way the head node can move.
+    _list::Node<int>* head = moved.head();
+    moved.erase(std::next(moved.begin(), 1));
+    EXPECT_NE(moved.head(), head);
+    EXPECT_EQ(moved.front(), 0);
+    EXPECT_TRUE(list.empty());
+}
+
+TEST(ListTest, RangesBuiltFromBatches) {
+    std::vector<int> values(5000);
+    for (int i = 0; i < 5000; ++i)
+        values[i] = i * 7 % 1000;
+    List<int> list(values.begin(), values.end());
+    std::list<int> reference(values.begin(), values.end());
+    expectSame(list, reference);
+
+    auto it = list.insert(std::next(list.begin(), 10), values.begin(), values.begin() + 2000);
+    auto referenceIt = reference.insert(std::next(reference.begin(), 10), values.begin(), values.begin() + 2000);
+    EXPECT_EQ(std::distance(list.begin(), it), std::distance(reference.begin(), referenceIt));
+    list.insert(list.end(), 1500, -1);
+    reference.insert(reference.end(), 1500, -1);
+    expectSame(list, reference);
+
+    std::istringstream stream("1 2 3 4 5 6 7 8 9 10");
+    list.assign(std::istream_iterator<int>(stream), std::istream_iterator<int>());
+    expectSame(list, std::list<int>{1, 2, 3, 4, 5, 6, 7, 8, 9, 10});
+    list.assign(3000, 4);
+    expectSame(list, std::list<int>(3000, 4));
+
+    List<int> copy(list), counted(2500, 9), none(0, 9);
+    expectSame(copy, list);
+    expectSame(counted, std::list<int>(2500, 9));
+    EXPECT_TRUE(none.empty());
+}
+
+TEST(ListTest, RandomOperationsMatchStdList) {
+    randomListOperations<List<int>>(1, 3000, 0);
+}
+
+TEST(ListTest, RandomOperationsOnThreadCachedPool) {
+    randomListOperations<List<int, FastAllocator<int, ThreadCachedPool>>>(3, 3000, 0.5);
+}
+
+TEST(ListTest, RandomOperationsOnStdAllocator) {
+    randomListOperations<List<int, std::allocator<int>>>(4, 3000, 0);
+}
+
+TEST(ListTest, BidirectionalIteratorsAndEmplace) {
+    List<std::pair<int, std::string>> list;
+    for (int i = 0; i < 100; ++i)
+        list.emplace_back(i, std::to_string(i));
+    list.emplace(std::next(list.begin(), 50), -1, "middle");
+    List<std::pair<int, std::string>>::const_iterator it = std::next(list.begin(), 50);
+    EXPECT_EQ(it->second, "middle");
+    EXPECT_EQ((--it)->first, 49);
+
+    std::vector<int> backwards;
+    for (auto reverse = list.rbegin(); reverse != list.rend(); ++reverse)
+        backwards.push_back(reverse->first);
+    EXPECT_EQ(backwards.size(), 101u);
+    EXPECT_EQ(backwards.front(), 99);
+    EXPECT_EQ(backwards.back(), 0);
+    EXPECT_EQ(std::prev(list.end())->first, 99);
+}
+
+// Batches pushed after a cache is gone hold a single chunk; a cache that
+// picks one up must count one chunk, not a full batch.
+TEST(ThreadCachedPoolTest, CacheCountsShortBatches) {
+    typedef _thread_cached_pool::CentralPool<200> Central;
+    void* carved;
+    Central::instance().allocateBatch(&carved, 1);
+    auto* chunk = static_cast<_thread_cached_pool::FreeChunk*>(carved);
+    chunk->next = nullptr;
+    Central::instance().pushBatch(chunk, 1);
+    {
+        _thread_cached_pool::ThreadCache<200> cache;
+        void* p = cache.allocate();
+        EXPECT_EQ(p, chunk);
+        EXPECT_EQ(cache.size(), 0);
+        cache.deallocate(p);
+        EXPECT_EQ(cache.size(), 1);
+    }
+    int count = 0;
+    EXPECT_EQ(Central::instance().popBatch(count), chunk);
+    EXPECT_EQ(count, 1);
+}
+
+TEST(FixedAllocatorTest, DecommittedBlocksKeepTheirBacking) {
+    typedef _fixed_allocator::Backing Backing;
+    FixedAllocator<64> allocator;
+    allocator.setBlockChunks(1024, 1024);
+    allocator.setBacking(Backing::mmap);
+    char* mapped = static_cast<char*>(allocator.allocateChunk());
+    allocator.deallocateChunk(mapped);
+    EXPECT_EQ(allocator.trim(), 1024u * 64);
+
+    allocator.setBacking(Backing::transparentHugePages);
+    char* huge = static_cast<char*>(allocator.allocateChunk());
+    EXPECT_TRUE(huge < mapped || huge >= mapped + 1024 * 64);
+    allocator.deallocateChunk(huge);
+    EXPECT_GT(allocator.trim(), 0u);
+
+    allocator.setBacking(Backing::mmap);
+    EXPECT_EQ(allocator.allocateChunk(), mapped);
+}
+
+// Counts copies and moves, so a test can check that emplace builds the
+// element where it ends up.
+struct Counted {
+    static int copiesAndMoves;
+    int value;
+
+    explicit Counted(int value) : value(value) {}
+
+    Counted(const Counted& another) : value(another.value) {
+        ++copiesAndMoves;
+    }
+
+    Counted(Counted&& another) : value(another.value) {
+        ++copiesAndMoves;
+    }
+
+    Counted& operator=(const Counted& another) {
+        value = another.value;
+        ++copiesAndMoves;
+        return *this;
+    }
+};
+
+int Counted::copiesAndMoves = 0;
+
+TEST(UnrolledListTest, EmplaceAtEndConstructsInPlace) {
+    UnrolledList<Counted, 4> list;
+    for (int i = 0; i < 10; ++i)
+        EXPECT_EQ(list.emplace(list.end(), i)->value, i);
+    EXPECT_EQ(list.emplace_back(10).value, 10);
+    EXPECT_EQ(Counted::copiesAndMoves, 0);
+    EXPECT_EQ(list.size(), 11);
+
+    struct Pinned {
+        int value;
+        explicit Pinned(int value) : value(value) {}
+        Pinned(const Pinned&) = delete;
+        Pinned(Pinned&&) = delete;
+    };
+    UnrolledList<Pinned, 4> pinned;
+    for (int i = 0; i < 10; ++i)
+        pinned.emplace_back(i);
+    pinned.pop_back();
+    EXPECT_EQ(pinned.back().value, 8);
+    EXPECT_EQ(pinned.front().value, 0);
+}
+
+// Nodes of this size class are used by no other test in this unit, so the
+// pool's reservation reflects only the tests below.
+struct Item {
+    char bytes[88];
+
+    explicit Item(char value = 0) {
+        bytes[0] = value;
+    }
+};
+
+std::size_t reservedItemChunks() {
+    return SingleThreadedPool::Instance<_fast_allocator::sizeClass(sizeof(_list::Node<Item>))>::pool.reservedChunks();
+}
+
+TEST(ListTest, RepeatedCopiesReuseFreedChunks) {
+    List<Item> list(1000, Item(1));
+    for (int i = 0; i < 2000; ++i) {
+        List<Item> copy(list);
+        ASSERT_EQ(copy.size(), 1000);
+    }
+    EXPECT_LE(reservedItemChunks(), 4u * 1000);
+}
+
+TEST(ListTest, RepeatedCompactionsStayBounded) {
+    List<Item> list;
+    list.set_auto_compact(0.25);
+    for (int i = 0; i < 10000; ++i)
+        list.push_back(Item(char(i)));
+    for (int i = 0; i < 200000; ++i)
+        list.erase(list.insert_after(list.head(), Item(-1)));
+    EXPECT_EQ(list.size(), 10000);
+    EXPECT_LE(reservedItemChunks(), 4u * 10000);
+    list.compact();
+    EXPECT_LT(list.fragmentation(), 0.01);
+    int i = 0;
+    for (const Item& item : list)
+        ASSERT_EQ(item.bytes[0], char(i++));
+}
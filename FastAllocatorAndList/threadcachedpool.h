@@ -0,0 +1,196 @@
+#pragma once
+
+#include "fixedallocator.h"
+#include <algorithm>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+
+// Pool policy for FastAllocator that can be shared between threads.
+// Every thread keeps its own free list per size class and talks to the
+// central pool (guarded by a mutex) only to move whole batches of chunks.
+// A chunk freed by another thread simply goes to that thread's cache:
+// chunks of one size class are interchangeable, and surplus batches flow
+// back to the central pool, where the allocating thread picks them up.
+namespace _thread_cached_pool {
+    const int batchSize = 64;
+
+    struct FreeChunk {
+        FreeChunk* next;
+    };
+
+    // Never destroyed, so thread caches flushed during static destruction
+    // and chunks freed after that still have a pool to go to.
+    // Chunks never go back to chunks_, so the pool keeps every block it
+    // ever carved and offers no trim().
+    template <int chunkSize>
+    class CentralPool {
+    private:
+        std::mutex mutex_;
+        // Batches with their lengths; most hold batchSize chunks, but
+        // flushes and frees after a cache is gone push shorter ones.
+        std::vector<std::pair<FreeChunk*, int>> batches_;
+        FixedAllocator<chunkSize> chunks_;
+
+    public:
+        static CentralPool& instance() {
+            static CentralPool* pool = new CentralPool();
+            return *pool;
+        }
+
+        FreeChunk* popBatch(int& count) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!batches_.empty()) {
+                FreeChunk* batch = batches_.back().first;
+                count = batches_.back().second;
+                batches_.pop_back();
+                return batch;
+            }
+            FreeChunk* batch = nullptr;
+            for (int i = 0; i < batchSize; ++i) {
+                FreeChunk* chunk = static_cast<FreeChunk*>(chunks_.allocateChunk());
+                chunk->next = batch;
+                batch = chunk;
+            }
+            count = batchSize;
+            return batch;
+        }
+
+        // Takes chunks from the pushed batches before carving new ones.
+        void allocateBatch(void** out, int n) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            int taken = 0;
+            while (taken < n && !batches_.empty()) {
+                std::pair<FreeChunk*, int>& batch = batches_.back();
+                for (; taken < n && batch.first; ++taken, --batch.second) {
+                    out[taken] = batch.first;
+                    batch.first = batch.first->next;
+                }
+                if (!batch.first)
+                    batches_.pop_back();
+            }
+            if (taken < n)
+                chunks_.allocateBatch(out + taken, n - taken);
+        }
+
+        void pushBatch(FreeChunk* batch, int count) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            batches_.emplace_back(batch, count);
+        }
+    };
+
+    // Set once the cache of this thread is destroyed. A trivial thread_local
+    // stays readable after that, unlike the cache itself.
+    template <int chunkSize>
+    bool& cacheDestroyed() {
+        thread_local bool destroyed = false;
+        return destroyed;
+    }
+
+    template <int chunkSize>
+    class ThreadCache {
+    private:
+        FreeChunk* head_;
+        int size_;
+
+        void flushBatch_() {
+            FreeChunk* batch = head_;
+            FreeChunk* last = head_;
+            int count = 1;
+            for (; count < batchSize && last->next; ++count)
+                last = last->next;
+            head_ = last->next;
+            last->next = nullptr;
+            size_ -= count;
+            CentralPool<chunkSize>::instance().pushBatch(batch, count);
+        }
+
+    public:
+        ThreadCache() : head_(nullptr), size_(0) {}
+
+        ~ThreadCache() {
+            while (head_)
+                flushBatch_();
+            cacheDestroyed<chunkSize>() = true;
+        }
+
+        void* allocate() {
+            if (!head_)
+                head_ = CentralPool<chunkSize>::instance().popBatch(size_);
+            FreeChunk* chunk = head_;
+            head_ = chunk->next;
+            --size_;
+            return chunk;
+        }
+
+        void deallocate(void* p) {
+            FreeChunk* chunk = static_cast<FreeChunk*>(p);
+            chunk->next = head_;
+            head_ = chunk;
+            if (++size_ == 2 * batchSize)
+                flushBatch_();
+        }
+
+        // Moves up to n chunks of this cache to out and returns how many.
+        int take(void** out, int n) {
+            int taken = 0;
+            for (; taken < n && head_; ++taken) {
+                out[taken] = head_;
+                head_ = head_->next;
+            }
+            size_ -= taken;
+            return taken;
+        }
+
+        // Chunks held by this cache.
+        int size() const {
+            return size_;
+        }
+    };
+}
+
+// The cache is a function-local thread_local: a thread_local static member
+// of a class template hits a GCC 12 bug ("redefinition of __tls_guard")
+// once several of them are instantiated in one translation unit.
+struct ThreadCachedPool {
+    template <int chunkSize>
+    static _thread_cached_pool::ThreadCache<chunkSize>& cache() {
+        thread_local _thread_cached_pool::ThreadCache<chunkSize> cache;
+        return cache;
+    }
+
+    // After the cache of the thread is gone (static destructors of the main
+    // thread run after it), chunks go to and come from the central pool.
+    template <int chunkSize>
+    static void* allocate() {
+        if (_thread_cached_pool::cacheDestroyed<chunkSize>()) {
+            void* chunk;
+            _thread_cached_pool::CentralPool<chunkSize>::instance().allocateBatch(&chunk, 1);
+            return chunk;
+        }
+        return cache<chunkSize>().allocate();
+    }
+
+    template <int chunkSize>
+    static void deallocate(void* p) {
+        if (_thread_cached_pool::cacheDestroyed<chunkSize>()) {
+            auto* chunk = static_cast<_thread_cached_pool::FreeChunk*>(p);
+            chunk->next = nullptr;
+            _thread_cached_pool::CentralPool<chunkSize>::instance().pushBatch(chunk, 1);
+            return;
+        }
+        cache<chunkSize>().deallocate(p);
+    }
+
+    // Drains the cache of this thread first, then the central pool, and
+    // sorts the chunks by address like FixedAllocator::allocateBatch.
+    template <int chunkSize>
+    static void allocateBatch(void** out, int n) {
+        int taken = 0;
+        if (!_thread_cached_pool::cacheDestroyed<chunkSize>())
+            taken = cache<chunkSize>().take(out, n);
+        _thread_cached_pool::CentralPool<chunkSize>::instance().allocateBatch(out + taken, n - taken);
+        std::sort(out, out + n);
+    }
+};
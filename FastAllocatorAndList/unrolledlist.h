@@ -0,0 +1,358 @@
+#pragma once
+
+#include "fastallocator.h"
+#include <iterator>
+#include <memory>
+#include <utility>
+
+
+namespace _unrolled_list {
+    template <typename T, int capacity>
+    struct Node {
+        Node* prev_;
+        Node* next_;
+        int size_;
+        alignas(T) unsigned char storage_[capacity * sizeof(T)];
+
+        Node() : prev_(nullptr), next_(nullptr), size_(0) {}
+
+        T* values() {
+            return reinterpret_cast<T*>(storage_);
+        }
+    };
+
+    // The largest capacity (at most 64) whose node fits the largest pooled
+    // size class. An element too large for even one per pooled node gets
+    // nodes of capacity 1, which the allocator takes from operator new.
+    template <typename T>
+    constexpr int defaultCapacity() {
+        int capacity = 64;
+        while (capacity > 1 && sizeof(Node<T, 64>) - 64 * sizeof(T) + capacity * sizeof(T)
+                               > std::size_t(_fast_allocator::maxPooledSize))
+            --capacity;
+        return capacity;
+    }
+}
+
+// Keeps up to nodeCapacity elements contiguously in every node. The default
+// capacity keeps a node within the largest FastAllocator size class when
+// one element leaves room for that.
+// Inserting into or erasing from a node invalidates iterators into that node
+// and into the node it is split into or merged with.
+template <typename T, int nodeCapacity = _unrolled_list::defaultCapacity<T>(),
+          class Allocator = FastAllocator<T>>
+class UnrolledList {
+private:
+    typedef _unrolled_list::Node<T, nodeCapacity> Node;
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<Node> NodeAllocator;
+
+    Node *head_, *tail_;
+    int size_;
+    NodeAllocator node_alloc_;
+
+    Node* new_node_(Node* prev, Node* next) {
+        Node* node = node_alloc_.allocate(1);
+        ::new((void*)node) Node();
+        node->prev_ = prev;
+        node->next_ = next;
+        if (prev)
+            prev->next_ = node;
+        else
+            head_ = node;
+        if (next)
+            next->prev_ = node;
+        else
+            tail_ = node;
+        return node;
+    }
+
+    void delete_node_(Node* node) {
+        if (node->prev_)
+            node->prev_->next_ = node->next_;
+        else
+            head_ = node->next_;
+        if (node->next_)
+            node->next_->prev_ = node->prev_;
+        else
+            tail_ = node->prev_;
+        node->~Node();
+        node_alloc_.deallocate(node, 1);
+    }
+
+    static void move_values_(Node* from, int index, Node* to) {
+        T* values = from->values();
+        for (int i = index; i < from->size_; ++i) {
+            ::new((void*)(to->values() + to->size_++)) T(std::move(values[i]));
+            values[i].~T();
+        }
+        from->size_ = index;
+    }
+
+    template <class... Args>
+    void insert_at_(Node* node, int index, Args&&... args) {
+        T* values = node->values();
+        if (index == node->size_)
+            ::new((void*)(values + index)) T(std::forward<Args>(args)...);
+        else {
+            T value(std::forward<Args>(args)...);
+            ::new((void*)(values + node->size_)) T(std::move(values[node->size_ - 1]));
+            for (int i = node->size_ - 1; i > index; --i)
+                values[i] = std::move(values[i - 1]);
+            values[index] = std::move(value);
+        }
+        ++node->size_;
+        ++size_;
+    }
+
+    void erase_at_(Node* node, int index) {
+        T* values = node->values();
+        for (int i = index; i + 1 < node->size_; ++i)
+            values[i] = std::move(values[i + 1]);
+        values[--node->size_].~T();
+        --size_;
+    }
+
+public:
+    template <class ValueType>
+    class UnrolledListIterator {
+    friend class UnrolledList;
+    template <class> friend class UnrolledListIterator;
+    private:
+        Node* node_;
+        int index_;
+        Node* const* tail_;
+
+        UnrolledListIterator(Node* node, int index, Node* const* tail)
+            : node_(node), index_(index), tail_(tail) {}
+
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef ValueType* pointer;
+        typedef ValueType& reference;
+
+        UnrolledListIterator() : node_(nullptr), index_(0), tail_(nullptr) {}
+
+        bool operator==(const UnrolledListIterator& another) const {
+            return node_ == another.node_ && index_ == another.index_;
+        }
+
+        bool operator!=(const UnrolledListIterator& another) const {
+            return !(*this == another);
+        }
+
+        UnrolledListIterator& operator++() {
+            if (++index_ == node_->size_) {
+                node_ = node_->next_;
+                index_ = 0;
+            }
+            return *this;
+        }
+
+        UnrolledListIterator& operator--() {
+            if (!node_) {
+                node_ = *tail_;
+                index_ = node_->size_ - 1;
+            }
+            else if (index_-- == 0) {
+                node_ = node_->prev_;
+                index_ = node_->size_ - 1;
+            }
+            return *this;
+        }
+
+        UnrolledListIterator operator++(int) {
+            UnrolledListIterator tmp(*this);
+            ++*this;
+            return tmp;
+        }
+
+        UnrolledListIterator operator--(int) {
+            UnrolledListIterator tmp(*this);
+            --*this;
+            return tmp;
+        }
+
+        ValueType& operator*() const {
+            return node_->values()[index_];
+        }
+
+        ValueType* operator->() const {
+            return node_->values() + index_;
+        }
+
+        operator UnrolledListIterator<const T>() const {
+            return UnrolledListIterator<const T>(node_, index_, tail_);
+        }
+    };
+
+    typedef UnrolledListIterator<T> iterator;
+    typedef UnrolledListIterator<const T> const_iterator;
+
+    explicit UnrolledList(const Allocator& alloc = Allocator())
+        : head_(nullptr), tail_(nullptr), size_(0), node_alloc_(alloc) {}
+
+    UnrolledList(const UnrolledList& another)
+        : head_(nullptr), tail_(nullptr), size_(0), node_alloc_(another.node_alloc_) {
+        for (const T& value : another)
+            push_back(value);
+    }
+
+    UnrolledList(UnrolledList&& another)
+        : head_(another.head_), tail_(another.tail_), size_(another.size_),
+          node_alloc_(std::move(another.node_alloc_)) {
+        another.head_ = another.tail_ = nullptr;
+        another.size_ = 0;
+    }
+
+    UnrolledList& operator=(UnrolledList another) {
+        std::swap(head_, another.head_);
+        std::swap(tail_, another.tail_);
+        std::swap(size_, another.size_);
+        return *this;
+    }
+
+    ~UnrolledList() {
+        clear();
+    }
+
+    void clear() {
+        while (head_) {
+            for (int i = 0; i < head_->size_; ++i)
+                head_->values()[i].~T();
+            delete_node_(head_);
+        }
+        size_ = 0;
+    }
+
+    int size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    iterator begin() {
+        return iterator(head_, 0, &tail_);
+    }
+
+    iterator end() {
+        return iterator(nullptr, 0, &tail_);
+    }
+
+    const_iterator begin() const {
+        return const_iterator(head_, 0, &tail_);
+    }
+
+    const_iterator end() const {
+        return const_iterator(nullptr, 0, &tail_);
+    }
+
+    T& front() {
+        return head_->values()[0];
+    }
+
+    T& back() {
+        return tail_->values()[tail_->size_ - 1];
+    }
+
+    const T& front() const {
+        return head_->values()[0];
+    }
+
+    const T& back() const {
+        return tail_->values()[tail_->size_ - 1];
+    }
+
+    void push_back(const T& value) {
+        emplace_back(value);
+    }
+
+    void push_back(T&& value) {
+        emplace_back(std::move(value));
+    }
+
+    // Constructs the element in place, so T need not be movable.
+    template <class... Args>
+    T& emplace_back(Args&&... args) {
+        if (!tail_ || tail_->size_ == nodeCapacity)
+            new_node_(tail_, nullptr);
+        T* value = ::new((void*)(tail_->values() + tail_->size_)) T(std::forward<Args>(args)...);
+        ++tail_->size_;
+        ++size_;
+        return *value;
+    }
+
+    void push_front(const T& value) {
+        if (!head_ || head_->size_ == nodeCapacity)
+            new_node_(nullptr, head_);
+        insert_at_(head_, 0, value);
+    }
+
+    void push_front(T&& value) {
+        if (!head_ || head_->size_ == nodeCapacity)
+            new_node_(nullptr, head_);
+        insert_at_(head_, 0, std::move(value));
+    }
+
+    void pop_back() {
+        tail_->values()[--tail_->size_].~T();
+        --size_;
+        if (!tail_->size_)
+            delete_node_(tail_);
+    }
+
+    void pop_front() {
+        erase_at_(head_, 0);
+        if (!head_->size_)
+            delete_node_(head_);
+    }
+
+    iterator insert(const_iterator pos, const T& value) {
+        return emplace(pos, value);
+    }
+
+    iterator insert(const_iterator pos, T&& value) {
+        return emplace(pos, std::move(value));
+    }
+
+    template <class... Args>
+    iterator emplace(const_iterator pos, Args&&... args) {
+        Node* node = pos.node_;
+        int index = pos.index_;
+        if (!node) {
+            emplace_back(std::forward<Args>(args)...);
+            return iterator(tail_, tail_->size_ - 1, &tail_);
+        }
+        if (node->size_ == nodeCapacity) {
+            Node* next = new_node_(node, node->next_);
+            move_values_(node, nodeCapacity / 2, next);
+            if (index >= nodeCapacity / 2) {
+                node = next;
+                index -= nodeCapacity / 2;
+            }
+        }
+        insert_at_(node, index, std::forward<Args>(args)...);
+        return iterator(node, index, &tail_);
+    }
+
+    iterator erase(const_iterator pos) {
+        Node* node = pos.node_;
+        int index = pos.index_;
+        erase_at_(node, index);
+        Node* next = node->next_;
+        if (!node->size_) {
+            delete_node_(node);
+            return iterator(next, 0, &tail_);
+        }
+        if (next && node->size_ + next->size_ <= nodeCapacity / 2) {
+            move_values_(next, 0, node);
+            delete_node_(next);
+        }
+        if (index == node->size_)
+            return iterator(node->next_, 0, &tail_);
+        return iterator(node, index, &tail_);
+    }
+};
@@ -0,0 +1,288 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "reclamation.h"
+#include "smartpointers.h"
+
+
+struct Payload {
+    long long key;
+    long long value;
+
+    Payload(long long key, long long value) : key(key), value(value) {}
+};
+
+template <class Pointer, class Make>
+double createAndDestroy(int size, int rounds, Make make) {
+    std::vector<Pointer> pointers;
+    pointers.reserve(size);
+    long long checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        for (int i = 0; i < size; ++i)
+            pointers.push_back(make(i));
+        for (const Pointer& pointer : pointers)
+            checksum += pointer->value;
+        pointers.clear();
+    }
+    double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    volatile long long sink = checksum;
+    (void)sink;
+    return time;
+}
+
+void benchmarkMakeShared(int size = 1000000, int rounds = 10) {
+    std::cout << "\nCreate/destroy " << rounds << " x " << size
+              << " shared objects:\n***********************\n";
+    double constructor = createAndDestroy<SharedPtr<Payload>>(size, rounds, [](int i) {
+        return SharedPtr<Payload>(new Payload(i, i));
+    });
+    double makeShared = createAndDestroy<SharedPtr<Payload>>(size, rounds, [](int i) {
+        return MakeShared<Payload>(i, i);
+    });
+    double standard = createAndDestroy<std::shared_ptr<Payload>>(size, rounds, [](int i) {
+        return std::make_shared<Payload>(i, i);
+    });
+    double operations = double(size) * rounds;
+    std::cout << "SharedPtr(new T):     time = " << constructor << " s, "
+              << operations / constructor / 1e6 << " M objects/s\n"
+              << "MakeShared<T>:        time = " << makeShared << " s, "
+              << operations / makeShared / 1e6 << " M objects/s\n"
+              << "std::make_shared<T>:  time = " << standard << " s, "
+              << operations / standard / 1e6 << " M objects/s\n";
+}
+
+// Few live objects at a time: control blocks keep cycling through the
+// thread cache instead of going back to malloc.
+void benchmarkControlBlockChurn(int live = 64, int rounds = 200000) {
+    std::cout << "\nControl block churn, " << rounds << " x " << live
+              << " objects:\n***********************\n";
+    Payload payload(1, 1);
+    double pooled = createAndDestroy<SharedPtr<Payload>>(live, rounds, [&payload](int) {
+        return MakeShared<Payload>(payload);
+    });
+    double standard = createAndDestroy<std::shared_ptr<Payload>>(live, rounds, [&payload](int) {
+        return std::make_shared<Payload>(payload);
+    });
+    double operations = double(live) * rounds;
+    std::cout << "MakeShared<T>, pooled block: time = " << pooled << " s, "
+              << operations / pooled / 1e6 << " M objects/s\n"
+              << "std::make_shared<T>:         time = " << standard << " s, "
+              << operations / standard / 1e6 << " M objects/s\n";
+}
+
+template <class Pointer>
+void copyAndDestroy(const Pointer& shared, int rounds) {
+    for (int i = 0; i < rounds; ++i) {
+        Pointer copy(shared);
+        Pointer another(copy);
+    }
+}
+
+template <class Pointer>
+double timeCopiesOnThreads(const Pointer& shared, int threadsNumber, int rounds) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threadsNumber; ++i)
+        threads.emplace_back(copyAndDestroy<Pointer>, std::cref(shared), rounds);
+    for (auto& thread : threads)
+        thread.join();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void benchmarkCountingContention(int maxThreads = 16, int rounds = 1000000) {
+    std::cout << "\nCopy/destroy of one shared object, " << rounds
+              << " x 2 copies per thread:\n***********************\n";
+    SharedPtr<Payload> single = MakeShared<Payload>(1, 1);
+    SharedPtr<Payload, AtomicCounting> atomic = MakeShared<Payload, AtomicCounting>(1, 1);
+    std::shared_ptr<Payload> standard = std::make_shared<Payload>(1, 1);
+    double plain = timeCopiesOnThreads(single, 1, rounds);
+    std::cout << "SingleThreadedCounting, 1 thread: time = " << plain << " s, "
+              << 2.0 * rounds / plain / 1e6 << " M copies/s\n";
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        double shared = timeCopiesOnThreads(atomic, threads, rounds);
+        double reference = timeCopiesOnThreads(standard, threads, rounds);
+        double copies = 2.0 * threads * rounds;
+        std::cout << "threads = " << threads << ":\n"
+                  << "    AtomicCounting:  time = " << shared << " s, "
+                  << copies / shared / 1e6 << " M copies/s\n"
+                  << "    std::shared_ptr: time = " << reference << " s, "
+                  << copies / reference / 1e6 << " M copies/s\n";
+    }
+}
+
+class LockedSnapshot {
+private:
+    mutable std::mutex mutex_;
+    SharedPtr<Payload, AtomicCounting> value_;
+
+public:
+    explicit LockedSnapshot(const SharedPtr<Payload, AtomicCounting>& value) : value_(value) {}
+
+    SharedPtr<Payload, AtomicCounting> load() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return value_;
+    }
+
+    void store(const SharedPtr<Payload, AtomicCounting>& value) {
+        SharedPtr<Payload, AtomicCounting> old;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            old = value_;
+            value_ = value;
+        }
+    }
+};
+
+// One writer republishes the snapshot every 100 microseconds while readers
+// time every single load.
+template <class Slot>
+std::vector<double> readerLatencies(int readers, int loads) {
+    Slot slot(MakeShared<Payload, AtomicCounting>(0, 0));
+    std::atomic<bool> stop(false);
+    std::thread writer([&slot, &stop]() {
+        for (long long version = 1; !stop.load(); ++version) {
+            slot.store(MakeShared<Payload, AtomicCounting>(version, version));
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    });
+    std::vector<std::vector<double>> latencies(readers, std::vector<double>(loads));
+    std::vector<std::thread> threads;
+    for (int r = 0; r < readers; ++r)
+        threads.emplace_back([&slot, &latencies, r, loads]() {
+            long long checksum = 0;
+            for (int i = 0; i < loads; ++i) {
+                auto start = std::chrono::steady_clock::now();
+                checksum += slot.load()->value;
+                latencies[r][i] = std::chrono::duration<double, std::nano>(
+                    std::chrono::steady_clock::now() - start).count();
+            }
+            volatile long long sink = checksum;
+            (void)sink;
+        });
+    for (auto& thread : threads)
+        thread.join();
+    stop.store(true);
+    writer.join();
+    std::vector<double> all;
+    for (const auto& reader : latencies)
+        all.insert(all.end(), reader.begin(), reader.end());
+    std::sort(all.begin(), all.end());
+    return all;
+}
+
+void printLatencies(const char* name, const std::vector<double>& sorted) {
+    std::cout << name << "p50 = " << sorted[sorted.size() / 2] << " ns, "
+              << "p99 = " << sorted[sorted.size() * 99 / 100] << " ns, "
+              << "p99.9 = " << sorted[sorted.size() * 999 / 1000] << " ns, "
+              << "max = " << sorted.back() << " ns\n";
+}
+
+void benchmarkSnapshotReads(int maxReaders = 8, int loads = 1000000) {
+    std::cout << "\nSnapshot reads with one writer, " << loads
+              << " loads per reader:\n***********************\n";
+    for (int readers = 1; readers <= maxReaders; readers *= 2) {
+        std::cout << "readers = " << readers << ":\n";
+        printLatencies("    AtomicSharedPtr: ", readerLatencies<AtomicSharedPtr<Payload>>(readers, loads));
+        printLatencies("    std::mutex:      ", readerLatencies<LockedSnapshot>(readers, loads));
+    }
+}
+
+struct Message : IntrusiveRefCounted<Message, AtomicCounting> {
+    long long key;
+    long long value;
+
+    Message(long long key, long long value) : key(key), value(value) {}
+};
+
+// Copies a shuffled vector of pointers and reads every object, so each copy
+// touches the counter and the data of a different object.
+template <class Pointer, class Make>
+double copyScattered(int size, int rounds, Make make) {
+    std::vector<Pointer> pointers;
+    for (int i = 0; i < size; ++i)
+        pointers.push_back(make(i));
+    std::shuffle(pointers.begin(), pointers.end(), std::mt19937(size));
+    long long checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        std::vector<Pointer> copies(pointers);
+        for (const Pointer& pointer : copies)
+            checksum += pointer->value;
+    }
+    double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    volatile long long sink = checksum;
+    (void)sink;
+    return time;
+}
+
+void benchmarkIntrusiveCopies(int size = 1000000, int rounds = 10) {
+    std::cout << "\nCopying " << rounds << " x " << size
+              << " scattered pointers (atomic counts):\n***********************\n";
+    double intrusive = copyScattered<IntrusivePtr<Message>>(size, rounds, [](int i) {
+        return MakeIntrusive<Message>(i, i);
+    });
+    double shared = copyScattered<SharedPtr<Payload, AtomicCounting>>(size, rounds, [](int i) {
+        return SharedPtr<Payload, AtomicCounting>(new Payload(i, i));
+    });
+    double inlined = copyScattered<SharedPtr<Payload, AtomicCounting>>(size, rounds, [](int i) {
+        return MakeShared<Payload, AtomicCounting>(i, i);
+    });
+    double standard = copyScattered<std::shared_ptr<Payload>>(size, rounds, [](int i) {
+        return std::make_shared<Payload>(i, i);
+    });
+    double copies = double(size) * rounds;
+    std::cout << "IntrusivePtr:        time = " << intrusive << " s, "
+              << copies / intrusive / 1e6 << " M copies/s\n"
+              << "SharedPtr(new T):    time = " << shared << " s, "
+              << copies / shared / 1e6 << " M copies/s\n"
+              << "MakeShared<T>:       time = " << inlined << " s, "
+              << copies / inlined / 1e6 << " M copies/s\n"
+              << "std::make_shared<T>: time = " << standard << " s, "
+              << copies / standard / 1e6 << " M copies/s\n";
+}
+
+struct Graph {
+    std::vector<std::vector<int>> adjacency;
+
+    explicit Graph(int vertices) : adjacency(vertices, std::vector<int>(16)) {}
+};
+
+// Times dropping the last SharedPtr to a graph of the given size. With
+// deferred deletion the destructor runs on the background drain thread.
+std::vector<double> releaseLatencies(int graphs, int vertices, bool deferred) {
+    ReclamationDomain domain;
+    if (deferred)
+        domain.startBackgroundDrain();
+    std::vector<double> latencies;
+    for (int i = 0; i < graphs; ++i) {
+        SharedPtr<Graph> graph = deferred ? SharedPtr<Graph>(new Graph(vertices), DeferredDelete<Graph>(domain))
+                                          : SharedPtr<Graph>(new Graph(vertices));
+        auto start = std::chrono::steady_clock::now();
+        graph.reset();
+        latencies.push_back(std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    return latencies;
+}
+
+void benchmarkDeferredReclamation(int graphs = 2000, int vertices = 10000) {
+    std::cout << "\nDropping the last SharedPtr to a graph of " << vertices
+              << " vertices, " << graphs << " times:\n***********************\n";
+    for (bool deferred : {false, true}) {
+        std::vector<double> sorted = releaseLatencies(graphs, vertices, deferred);
+        std::cout << (deferred ? "DeferredDelete: " : "delete inline:  ")
+                  << "p50 = " << sorted[sorted.size() / 2] << " us, "
+                  << "p99 = " << sorted[sorted.size() * 99 / 100] << " us, "
+                  << "max = " << sorted.back() << " us\n";
+    }
+}
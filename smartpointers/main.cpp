@@ -0,0 +1,18 @@
+#include "benchmark.h"
+
+int main() {
+
+    benchmarkMakeShared();
+
+    benchmarkControlBlockChurn();
+
+    benchmarkCountingContention();
+
+    benchmarkSnapshotReads();
+
+    benchmarkIntrusiveCopies();
+
+    benchmarkDeferredReclamation();
+
+    return 0;
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Epoch-based reclamation. Readers that touch shared objects without owning
+// them hold a Guard; retired objects are destroyed by drain() (or by the
+// background thread) only once every guard that was active at retirement
+// has been released. Destruction thus never happens on the retiring thread.
+namespace _reclamation {
+    struct ThreadRecord {
+        std::atomic<std::uint64_t> epoch;
+        std::atomic<bool> inUse;
+        ThreadRecord* next;
+
+        ThreadRecord() : epoch(0), inUse(true), next(nullptr) {}
+    };
+
+    struct Retired {
+        void* object;
+        void (*destroy)(void*);
+        std::uint64_t epoch;
+    };
+
+    template <typename T>
+    void destroy(void* object) {
+        delete static_cast<T*>(object);
+    }
+}
+
+class ReclamationDomain {
+private:
+    // Epoch 0 marks an idle record, so counting starts from 1.
+    std::atomic<std::uint64_t> epoch_;
+    std::atomic<_reclamation::ThreadRecord*> records_;
+
+    std::mutex retiredMutex_;
+    std::vector<_reclamation::Retired> retired_;
+
+    std::mutex drainMutex_;
+    std::condition_variable stopDrain_;
+    std::thread drainThread_;
+    bool draining_;
+
+    _reclamation::ThreadRecord* acquireRecord_() {
+        for (auto* record = records_.load(); record; record = record->next) {
+            bool expected = false;
+            if (record->inUse.compare_exchange_strong(expected, true))
+                return record;
+        }
+        auto* record = new _reclamation::ThreadRecord();
+        record->next = records_.load();
+        while (!records_.compare_exchange_weak(record->next, record)) {}
+        return record;
+    }
+
+    std::uint64_t oldestActiveEpoch_() const {
+        std::uint64_t oldest = UINT64_MAX;
+        for (auto* record = records_.load(); record; record = record->next) {
+            std::uint64_t epoch = record->epoch.load();
+            if (epoch && epoch < oldest)
+                oldest = epoch;
+        }
+        return oldest;
+    }
+
+public:
+    class Guard {
+    private:
+        _reclamation::ThreadRecord* record_;
+
+    public:
+        // Publishing the epoch is retried until it is still current, so a
+        // concurrent drain() either sees this guard or has already moved on
+        // past everything the guard could reach.
+        explicit Guard(ReclamationDomain& domain) : record_(domain.acquireRecord_()) {
+            std::uint64_t epoch = domain.epoch_.load();
+            while (true) {
+                record_->epoch.store(epoch);
+                std::uint64_t current = domain.epoch_.load();
+                if (current == epoch)
+                    break;
+                epoch = current;
+            }
+        }
+
+        Guard(const Guard&) = delete;
+
+        Guard& operator=(const Guard&) = delete;
+
+        ~Guard() {
+            record_->epoch.store(0);
+            record_->inUse.store(false);
+        }
+    };
+
+    ReclamationDomain() : epoch_(1), records_(nullptr), draining_(false) {}
+
+    ReclamationDomain(const ReclamationDomain&) = delete;
+
+    ReclamationDomain& operator=(const ReclamationDomain&) = delete;
+
+    // No guards may be active any more: everything still retired is destroyed.
+    ~ReclamationDomain() {
+        stopBackgroundDrain();
+        for (const _reclamation::Retired& retired : retired_)
+            retired.destroy(retired.object);
+        for (auto* record = records_.load(); record;) {
+            auto* next = record->next;
+            delete record;
+            record = next;
+        }
+    }
+
+    static ReclamationDomain& global() {
+        static ReclamationDomain domain;
+        return domain;
+    }
+
+    void retire(void* object, void (*destroy)(void*)) {
+        std::lock_guard<std::mutex> lock(retiredMutex_);
+        retired_.push_back(_reclamation::Retired{object, destroy, epoch_.load()});
+    }
+
+    template <typename T>
+    void retire(T* object) {
+        retire(object, _reclamation::destroy<T>);
+    }
+
+    std::size_t pending() {
+        std::lock_guard<std::mutex> lock(retiredMutex_);
+        return retired_.size();
+    }
+
+    // Destroys every object retired before all currently active guards were
+    // taken and returns how many there were.
+    std::size_t drain() {
+        epoch_.fetch_add(1);
+        std::uint64_t oldest = oldestActiveEpoch_();
+        std::vector<_reclamation::Retired> ready;
+        {
+            std::lock_guard<std::mutex> lock(retiredMutex_);
+            std::size_t kept = 0;
+            for (const _reclamation::Retired& retired : retired_)
+                if (retired.epoch < oldest)
+                    ready.push_back(retired);
+                else
+                    retired_[kept++] = retired;
+            retired_.resize(kept);
+        }
+        for (const _reclamation::Retired& retired : ready)
+            retired.destroy(retired.object);
+        return ready.size();
+    }
+
+    void startBackgroundDrain(std::chrono::microseconds interval = std::chrono::milliseconds(1)) {
+        std::lock_guard<std::mutex> lock(drainMutex_);
+        if (draining_)
+            return;
+        draining_ = true;
+        drainThread_ = std::thread([this, interval]() {
+            std::unique_lock<std::mutex> lock(drainMutex_);
+            while (draining_) {
+                lock.unlock();
+                drain();
+                lock.lock();
+                stopDrain_.wait_for(lock, interval, [this]() { return !draining_; });
+            }
+        });
+    }
+
+    void stopBackgroundDrain() {
+        {
+            std::lock_guard<std::mutex> lock(drainMutex_);
+            if (!draining_)
+                return;
+            draining_ = false;
+        }
+        stopDrain_.notify_all();
+        drainThread_.join();
+        drain();
+    }
+};
+
+// Deleter for SharedPtr and UniquePtr that hands the object to a
+// reclamation domain instead of destroying it in place:
+//     SharedPtr<Graph> graph(new Graph(), DeferredDelete<Graph>());
+template <typename T>
+struct DeferredDelete {
+    ReclamationDomain* domain;
+
+    explicit DeferredDelete(ReclamationDomain& domain = ReclamationDomain::global()) : domain(&domain) {}
+
+    void operator()(T* object) const {
+        domain->retire(object);
+    }
+};
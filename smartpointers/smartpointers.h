@@ -1,97 +1,535 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <memory>
+#include <type_traits>
+#include <utility>
+#include "../FastAllocatorAndList/fastallocator.h"
+#include "../FastAllocatorAndList/threadcachedpool.h"
+
+namespace _smart_pointers {
+    // Keeps a stateless deleter as an empty base, so that UniquePtr with such
+    // a deleter is exactly one pointer wide.
+    template <typename T, class Deleter,
+              bool empty = std::is_empty<Deleter>::value && !std::is_final<Deleter>::value>
+    class UniqueStorage : private Deleter {
+    private:
+        T* ptr_;
+
+    public:
+        UniqueStorage(T* ptr, const Deleter& deleter) : Deleter(deleter), ptr_(ptr) {}
+
+        T*& ptr() {
+            return ptr_;
+        }
 
-template <typename T>
-class UniquePtr {
+        T* ptr() const {
+            return ptr_;
+        }
+
+        Deleter& deleter() {
+            return *this;
+        }
+
+        const Deleter& deleter() const {
+            return *this;
+        }
+    };
+
+    template <typename T, class Deleter>
+    class UniqueStorage<T, Deleter, false> {
+    private:
+        T* ptr_;
+        Deleter deleter_;
+
+    public:
+        UniqueStorage(T* ptr, const Deleter& deleter) : ptr_(ptr), deleter_(deleter) {}
+
+        T*& ptr() {
+            return ptr_;
+        }
+
+        T* ptr() const {
+            return ptr_;
+        }
+
+        Deleter& deleter() {
+            return deleter_;
+        }
+
+        const Deleter& deleter() const {
+            return deleter_;
+        }
+    };
+
+    // What UniquePtr<T> and UniquePtr<T[]> have in common.
+    template <typename T, class Deleter>
+    class UniqueBase {
+    template <typename U, class E> friend class UniqueBase;
+    protected:
+        UniqueStorage<T, Deleter> storage_;
+
+        UniqueBase(T* ptr, const Deleter& deleter) : storage_(ptr, deleter) {}
+
+        UniqueBase(UniqueBase&& another) : storage_(another.release(), std::move(another.get_deleter())) {}
+
+        template <typename U, class E>
+        UniqueBase(UniqueBase<U, E>&& another)
+            : storage_(another.release(), std::move(another.get_deleter())) {}
+
+        ~UniqueBase() {
+            reset();
+        }
+
+    public:
+        typedef T* pointer;
+        typedef T element_type;
+        typedef Deleter deleter_type;
+
+        UniqueBase(const UniqueBase& another) = delete;
+
+        UniqueBase& operator=(const UniqueBase& another) = delete;
+
+        T* get() const {
+            return storage_.ptr();
+        }
+
+        Deleter& get_deleter() {
+            return storage_.deleter();
+        }
+
+        const Deleter& get_deleter() const {
+            return storage_.deleter();
+        }
+
+        T* release() {
+            T* tmp = storage_.ptr();
+            storage_.ptr() = nullptr;
+            return tmp;
+        }
+
+        // The new pointer is stored before the old one is destroyed, so the
+        // deleter never sees a half-reset UniquePtr.
+        void reset(T* ptr = nullptr) {
+            T* old = storage_.ptr();
+            storage_.ptr() = ptr;
+            if (old)
+                storage_.deleter()(old);
+        }
+
+        explicit operator bool() const {
+            return storage_.ptr() != nullptr;
+        }
+    };
+}
+
+template <typename T, class Deleter = std::default_delete<T>>
+class UniquePtr : public _smart_pointers::UniqueBase<T, Deleter> {
 private:
-    T* ptr_;
+    typedef _smart_pointers::UniqueBase<T, Deleter> Base;
 
 public:
-    explicit UniquePtr(T* ptr) : ptr_(ptr) {}
+    UniquePtr() : Base(nullptr, Deleter()) {}
 
-    UniquePtr(UniquePtr&& another) : ptr_(another.release()) {}
+    explicit UniquePtr(T* ptr, const Deleter& deleter = Deleter()) : Base(ptr, deleter) {}
 
-    UniquePtr(const UniquePtr& another) = delete;
+    UniquePtr(UniquePtr&& another) : Base(std::move(another)) {}
 
-    ~UniquePtr() {
-        reset();
-    }
+    // Same constraints as std::unique_ptr: no arrays, and both the pointer
+    // and the deleter must convert.
+    template <typename U, class E, typename = typename std::enable_if<
+            !std::is_array<U>::value &&
+            std::is_convertible<typename UniquePtr<U, E>::pointer, T*>::value &&
+            std::is_convertible<E, Deleter>::value>::type>
+    UniquePtr(UniquePtr<U, E>&& another) : Base(std::move(another)) {}
 
-    T* get() const {
-        return ptr_;
+    UniquePtr& operator=(UniquePtr&& another) {
+        this->reset(another.release());
+        this->get_deleter() = std::move(another.get_deleter());
+        return *this;
     }
 
     T& operator*() const {
-        return *ptr_;
+        return *this->get();
     }
 
     T* operator->() const {
-        return ptr_;
+        return this->get();
     }
 
-    T* release() {
-        T* tmp = ptr_;
-        ptr_ = nullptr;
-        return tmp;
+    void swap(UniquePtr& another) {
+        std::swap(this->storage_, another.storage_);
     }
+};
 
-    void reset(T* ptr) {
-        if (ptr_)
-            delete ptr_;
-        ptr_ = ptr;
-    }
+template <typename T, class Deleter>
+class UniquePtr<T[], Deleter> : public _smart_pointers::UniqueBase<T, Deleter> {
+private:
+    typedef _smart_pointers::UniqueBase<T, Deleter> Base;
 
-    void reset() {
-        reset(nullptr);
-    }
+public:
+    UniquePtr() : Base(nullptr, Deleter()) {}
+
+    explicit UniquePtr(T* ptr, const Deleter& deleter = Deleter()) : Base(ptr, deleter) {}
+
+    UniquePtr(UniquePtr&& another) : Base(std::move(another)) {}
 
     UniquePtr& operator=(UniquePtr&& another) {
-        reset(another.release());
+        this->reset(another.release());
+        this->get_deleter() = std::move(another.get_deleter());
         return *this;
     }
 
+    T& operator[](std::size_t index) const {
+        return this->get()[index];
+    }
+
     void swap(UniquePtr& another) {
-        std::swap(*this, another);
+        std::swap(this->storage_, another.storage_);
     }
 };
 
-template <typename T> class WeakPtr;
+// Counting policies for SharedPtr and WeakPtr. SingleThreadedCounting is the
+// plain fast path; AtomicCounting lets pointers to one object be copied and
+// destroyed from several threads at once.
+struct SingleThreadedCounting {
+    typedef std::size_t Counter;
 
-template <typename T>
+    static std::size_t load(const Counter& counter) {
+        return counter;
+    }
+
+    static void increment(Counter& counter) {
+        ++counter;
+    }
+
+    // Returns true if the counter dropped to zero.
+    static bool decrement(Counter& counter) {
+        return --counter == 0;
+    }
+
+    static bool incrementIfNotZero(Counter& counter) {
+        if (!counter)
+            return false;
+        ++counter;
+        return true;
+    }
+};
+
+struct AtomicCounting {
+    typedef std::atomic<std::size_t> Counter;
+
+    static std::size_t load(const Counter& counter) {
+        return counter.load(std::memory_order_acquire);
+    }
+
+    // A new reference is always made from an existing one, so nothing has to
+    // be ordered here.
+    static void increment(Counter& counter) {
+        counter.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Release publishes our writes to the object, acquire makes the writes of
+    // all other owners visible to whoever destroys it.
+    static bool decrement(Counter& counter) {
+        return counter.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+    static bool incrementIfNotZero(Counter& counter) {
+        std::size_t current = counter.load(std::memory_order_relaxed);
+        while (current)
+            if (counter.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel,
+                                              std::memory_order_relaxed))
+                return true;
+        return false;
+    }
+};
+
+
+namespace _smart_pointers {
+    // Control blocks come from per-thread free lists of the matching
+    // FastAllocator size class; a block may be freed on any thread.
+    // Over-aligned blocks, which the pool cannot serve, use plain new.
+    template <class Block>
+    using BlockAllocator = FastAllocator<Block, ThreadCachedPool>;
+
+    template <class Block, class Allocator, class... Args>
+    Block* allocateBlock(const Allocator& alloc, Args&&... args) {
+        typedef typename std::allocator_traits<Allocator>::template rebind_alloc<Block> Rebound;
+        Rebound blockAlloc(alloc);
+        Block* block = std::allocator_traits<Rebound>::allocate(blockAlloc, 1);
+        try {
+            ::new((void*)block) Block(std::forward<Args>(args)...);
+        }
+        catch (...) {
+            std::allocator_traits<Rebound>::deallocate(blockAlloc, block, 1);
+            throw;
+        }
+        return block;
+    }
+
+    // The allocator may live inside the block, so it is copied out first.
+    template <class Block, class Allocator>
+    void deallocateBlock(const Allocator& alloc, Block* block) {
+        typedef typename std::allocator_traits<Allocator>::template rebind_alloc<Block> Rebound;
+        Rebound blockAlloc(alloc);
+        block->~Block();
+        std::allocator_traits<Rebound>::deallocate(blockAlloc, block, 1);
+    }
+
+    template <class Block, class... Args>
+    Block* newBlock(Args&&... args) {
+        if (alignof(Block) > alignof(std::max_align_t))
+            return new Block(std::forward<Args>(args)...);
+        return allocateBlock<Block>(BlockAllocator<Block>(), std::forward<Args>(args)...);
+    }
+
+    template <class Block>
+    void deleteBlock(Block* block) {
+        if (alignof(Block) > alignof(std::max_align_t))
+            delete block;
+        else
+            deallocateBlock(BlockAllocator<Block>(), block);
+    }
+
+    // softLinksCount is the number of weak pointers plus one while the object
+    // is alive, so the block is freed by whoever drops the last of either.
+    template <class Counting>
+    struct ControlBlock {
+        typename Counting::Counter count;
+        typename Counting::Counter softLinksCount;
+
+        ControlBlock() : count(1), softLinksCount(1) {}
+
+        virtual ~ControlBlock() {}
+
+        virtual void destroyObject() = 0;
+
+        virtual void destroySelf() = 0;
+
+        void addLink() {
+            Counting::increment(count);
+        }
+
+        bool addLinkIfAlive() {
+            return Counting::incrementIfNotZero(count);
+        }
+
+        void addSoftLink() {
+            Counting::increment(softLinksCount);
+        }
+
+        void releaseLink() {
+            if (Counting::decrement(count)) {
+                destroyObject();
+                releaseSoftLink();
+            }
+        }
+
+        void releaseSoftLink() {
+            if (Counting::decrement(softLinksCount))
+                destroySelf();
+        }
+
+        std::size_t useCount() const {
+            return Counting::load(count);
+        }
+    };
+
+    template <typename T, class Counting>
+    struct PointerControlBlock : ControlBlock<Counting> {
+        T* ptr;
+
+        explicit PointerControlBlock(T* ptr) : ptr(ptr) {}
+
+        void destroyObject() override {
+            delete ptr;
+        }
+
+        void destroySelf() override {
+            deleteBlock(this);
+        }
+    };
+
+    template <typename T, class Deleter, class Allocator, class Counting>
+    struct DeleterControlBlock : ControlBlock<Counting> {
+        T* ptr;
+        Deleter deleter;
+        Allocator allocator;
+
+        DeleterControlBlock(T* ptr, const Deleter& deleter, const Allocator& allocator)
+            : ptr(ptr), deleter(deleter), allocator(allocator) {}
+
+        void destroyObject() override {
+            deleter(ptr);
+        }
+
+        void destroySelf() override {
+            deallocateBlock(allocator, this);
+        }
+    };
+
+    template <typename T, class Counting>
+    struct InlineControlBlock : ControlBlock<Counting> {
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        template <class... Args>
+        explicit InlineControlBlock(Args&&... args) {
+            ::new((void*)storage) T(std::forward<Args>(args)...);
+        }
+
+        T* get() {
+            return reinterpret_cast<T*>(storage);
+        }
+
+        void destroyObject() override {
+            get()->~T();
+        }
+
+        void destroySelf() override {
+            deleteBlock(this);
+        }
+    };
+
+    template <typename T, class Allocator, class Counting>
+    struct AllocatedInlineControlBlock : InlineControlBlock<T, Counting> {
+        Allocator allocator;
+
+        template <class... Args>
+        explicit AllocatedInlineControlBlock(const Allocator& allocator, Args&&... args)
+            : InlineControlBlock<T, Counting>(std::forward<Args>(args)...), allocator(allocator) {}
+
+        void destroySelf() override {
+            deallocateBlock(allocator, this);
+        }
+    };
+
+    // Lets a SharedPtr own one reference of an intrusively counted object.
+    template <typename T, class Counting>
+    struct IntrusiveControlBlock : ControlBlock<Counting> {
+        T* ptr;
+
+        explicit IntrusiveControlBlock(T* ptr) : ptr(ptr) {
+            intrusiveAddRef(ptr);
+        }
+
+        void destroyObject() override {
+            intrusiveRelease(ptr);
+        }
+
+        void destroySelf() override {
+            deleteBlock(this);
+        }
+    };
+}
+
+template <typename T, class Counting = SingleThreadedCounting> class SharedPtr;
+template <typename T, class Counting = SingleThreadedCounting> class WeakPtr;
+template <typename T> class AtomicSharedPtr;
+template <typename T> class IntrusivePtr;
+
+// Constructs the object inside its control block: one allocation instead
+// of one for the object and one for the counters.
+template <typename T, class Counting = SingleThreadedCounting, class... Args>
+SharedPtr<T, Counting> MakeShared(Args&&... args);
+
+// Like MakeShared, but the block with the object comes from alloc.
+template <typename T, class Counting = SingleThreadedCounting, class Allocator, class... Args>
+SharedPtr<T, Counting> AllocateShared(const Allocator& alloc, Args&&... args);
+
+template <class Counting = SingleThreadedCounting, typename T>
+SharedPtr<T, Counting> SharedFromIntrusive(const IntrusivePtr<T>& intrusive);
+
+template <typename T, class Counting>
 class SharedPtr {
-friend class WeakPtr<T>;
+friend class WeakPtr<T, Counting>;
+friend class AtomicSharedPtr<T>;
+template <typename U, class C> friend class SharedPtr;
+template <typename U, class C, class... Args> friend SharedPtr<U, C> MakeShared(Args&&... args);
+template <typename U, class C, class A, class... Args>
+friend SharedPtr<U, C> AllocateShared(const A& alloc, Args&&... args);
+template <class C, typename U> friend SharedPtr<U, C> SharedFromIntrusive(const IntrusivePtr<U>& intrusive);
 private:
-    T* ptr_;
-    std::size_t* count_;
-    std::size_t* soft_links_count_;
+    typedef _smart_pointers::ControlBlock<Counting> ControlBlock;
 
-public:
-    explicit SharedPtr(T* ptr) : ptr_(ptr), count_(new std::size_t(1)), soft_links_count_(new std::size_t(0)) {}
+    T* ptr_;
+    ControlBlock* block_;
 
-    SharedPtr() : ptr_(nullptr), count_(nullptr), soft_links_count_(nullptr) {}
+    SharedPtr(ControlBlock* block, T* ptr) : ptr_(ptr), block_(block) {}
 
-    SharedPtr(const SharedPtr& another)
-        : ptr_(another.ptr_), count_(another.count_), soft_links_count_(another.soft_links_count_) {
-            if (count_)
-                ++*count_;
+public:
+    // Like std::shared_ptr, deletes ptr if the control block cannot be
+    // allocated.
+    explicit SharedPtr(T* ptr) : ptr_(ptr), block_(nullptr) {
+        try {
+            block_ = _smart_pointers::newBlock<_smart_pointers::PointerControlBlock<T, Counting>>(ptr);
         }
+        catch (...) {
+            delete ptr;
+            throw;
+        }
+    }
 
-    SharedPtr(SharedPtr&& another)
-        : ptr_(another.ptr_), count_(another.count_), soft_links_count_(another.soft_links_count_) {
-            if (count_)
-                ++*count_;
+    // deleter(ptr) runs instead of delete ptr; the control block itself is
+    // allocated from alloc (a rebound copy of it).
+    template <class Deleter, class Allocator = _smart_pointers::BlockAllocator<char>>
+    SharedPtr(T* ptr, Deleter deleter, const Allocator& alloc = Allocator()) : ptr_(ptr), block_(nullptr) {
+        try {
+            block_ = _smart_pointers::allocateBlock<
+                _smart_pointers::DeleterControlBlock<T, Deleter, Allocator, Counting>>(alloc, ptr, deleter, alloc);
         }
+        catch (...) {
+            deleter(ptr);
+            throw;
+        }
+    }
+
+    SharedPtr() : ptr_(nullptr), block_(nullptr) {}
+
+    SharedPtr(const SharedPtr& another) : ptr_(another.ptr_), block_(another.block_) {
+        if (block_)
+            block_->addLink();
+    }
 
-    explicit SharedPtr(const WeakPtr<T>& weak)
-        : ptr_(weak.ptr_), count_(weak.count_), soft_links_count_(weak.soft_links_count_) {
-            if (count_)
-                ++*count_;
+    template <typename U>
+    SharedPtr(const SharedPtr<U, Counting>& another) : ptr_(another.ptr_), block_(another.block_) {
+        if (block_)
+            block_->addLink();
+    }
+
+    // Shares ownership with owner but points at ptr, typically a member of
+    // the owned object.
+    template <typename U>
+    SharedPtr(const SharedPtr<U, Counting>& owner, T* ptr) : ptr_(ptr), block_(owner.block_) {
+        if (block_)
+            block_->addLink();
+    }
+
+    SharedPtr(SharedPtr&& another) : ptr_(another.ptr_), block_(another.block_) {
+        another.ptr_ = nullptr;
+        another.block_ = nullptr;
+    }
+
+    template <typename U>
+    SharedPtr(SharedPtr<U, Counting>&& another) : ptr_(another.ptr_), block_(another.block_) {
+        another.ptr_ = nullptr;
+        another.block_ = nullptr;
+    }
+
+    // Empty if the object is already gone.
+    explicit SharedPtr(const WeakPtr<T, Counting>& weak) : ptr_(nullptr), block_(nullptr) {
+        if (weak.block_ && weak.block_->addLinkIfAlive()) {
+            ptr_ = weak.ptr_;
+            block_ = weak.block_;
         }
+    }
 
     void swap(SharedPtr& another) {
         std::swap(ptr_, another.ptr_);
-        std::swap(count_, another.count_);
-        std::swap(soft_links_count_, another.soft_links_count_);
+        std::swap(block_, another.block_);
     }
 
     SharedPtr& operator=(const SharedPtr& another) {
@@ -105,26 +543,16 @@ public:
     }
 
     ~SharedPtr() {
-        if (count_) {
-            --*count_;
-            if (!*count_) {
-                delete ptr_;
-                if (!soft_links_count_ || !*soft_links_count_) {
-                    delete count_;
-                    delete soft_links_count_;
-                }
-            }
-        }
-        else
-            delete ptr_;
+        if (block_)
+            block_->releaseLink();
     }
 
     std::size_t use_count() const {
-        return count_ ? *count_ : 0;
+        return block_ ? block_->useCount() : 0;
     }
 
     bool expired() const {
-        return !count_ || *count_ == 0;
+        return use_count() == 0;
     }
 
     T* get() const {
@@ -140,95 +568,372 @@ public:
     }
 
     void reset() {
-        SharedPtr<T>().swap(*this);
+        SharedPtr().swap(*this);
     }
 
-    template<class U> 
+    template<class U>
     void reset(U* ptr) {
-        SharedPtr<T>(ptr).swap(*this);
+        SharedPtr(ptr).swap(*this);
     }
 };
 
+template <typename T, class Counting, class... Args>
+SharedPtr<T, Counting> MakeShared(Args&&... args) {
+    auto* block = _smart_pointers::newBlock<_smart_pointers::InlineControlBlock<T, Counting>>(
+        std::forward<Args>(args)...);
+    return SharedPtr<T, Counting>(block, block->get());
+}
 
-template <typename T>
+template <typename T, class Counting, class Allocator, class... Args>
+SharedPtr<T, Counting> AllocateShared(const Allocator& alloc, Args&&... args) {
+    auto* block = _smart_pointers::allocateBlock<_smart_pointers::AllocatedInlineControlBlock<T, Allocator, Counting>>(
+        alloc, alloc, std::forward<Args>(args)...);
+    return SharedPtr<T, Counting>(block, block->get());
+}
+
+
+template <typename T, class Counting>
 class WeakPtr {
-friend class SharedPtr<T>;
+friend class SharedPtr<T, Counting>;
 private:
     T* ptr_;
-    std::size_t* count_;
-    std::size_t* soft_links_count_;
+    _smart_pointers::ControlBlock<Counting>* block_;
 
 public:
-    WeakPtr(const SharedPtr<T>& shared)
-        : ptr_(shared.ptr_), count_(shared.count_), soft_links_count_(new std::size_t(1)) {}
+    WeakPtr(const SharedPtr<T, Counting>& shared) : ptr_(shared.ptr_), block_(shared.block_) {
+        if (block_)
+            block_->addSoftLink();
+    }
 
-    WeakPtr(const WeakPtr& another)
-        : ptr_(another.ptr_), count_(another.count_), soft_links_count_(another.soft_links_count_) {
-            if (soft_links_count_)
-                ++*soft_links_count_;
-        }
+    WeakPtr(const WeakPtr& another) : ptr_(another.ptr_), block_(another.block_) {
+        if (block_)
+            block_->addSoftLink();
+    }
 
-    WeakPtr(WeakPtr&& another)
-        : ptr_(another.ptr_), count_(another.count_), soft_links_count_(another.soft_links_count_) {
-            if (soft_links_count_)
-                ++*soft_links_count_;
-        }
+    WeakPtr(WeakPtr&& another) : ptr_(another.ptr_), block_(another.block_) {
+        another.ptr_ = nullptr;
+        another.block_ = nullptr;
+    }
 
-    WeakPtr() : ptr_(nullptr), count_(nullptr), soft_links_count_(nullptr) {}
+    WeakPtr() : ptr_(nullptr), block_(nullptr) {}
 
     void swap(WeakPtr& another) {
         std::swap(ptr_, another.ptr_);
-        std::swap(count_, another.count_);
-        std::swap(soft_links_count_, another.soft_links_count_);
+        std::swap(block_, another.block_);
     }
 
     WeakPtr& operator=(const WeakPtr& another) {
-        WeakPtr<T>(another).swap(*this);
+        WeakPtr(another).swap(*this);
         return *this;
     }
 
     WeakPtr& operator=(WeakPtr&& another) {
-        WeakPtr<T>(std::move(another)).swap(*this);
+        WeakPtr(std::move(another)).swap(*this);
         return *this;
     }
 
-    WeakPtr& operator=(const SharedPtr<T>& another) {
-        count_ = another.count_;
-        ptr_ = another.ptr_;
-        if (soft_links_count_)
-            --*soft_links_count_;
-        soft_links_count_ = another.soft_links_count_;
-        if (soft_links_count_)
-            ++*soft_links_count_;
+    WeakPtr& operator=(const SharedPtr<T, Counting>& another) {
+        WeakPtr(another).swap(*this);
         return *this;
     }
 
     ~WeakPtr() {
-        if (soft_links_count_) {
-            --*soft_links_count_;
-            if (!*soft_links_count_) {
-                delete soft_links_count_;
-                if (count_ && !*count_)
-                    delete count_;
+        if (block_)
+            block_->releaseSoftLink();
+    }
+
+    std::size_t use_count() const {
+        return block_ ? block_->useCount() : 0;
+    }
+
+    bool expired() const {
+        return use_count() == 0;
+    }
+
+    SharedPtr<T, Counting> lock() const {
+        return SharedPtr<T, Counting>(*this);
+    }
+
+    void reset() {
+        WeakPtr().swap(*this);
+    }
+};
+
+
+// A SharedPtr slot that can be read and replaced concurrently. Readers never
+// block: the slot word packs a pointer to a holder of the current SharedPtr
+// together with a 16-bit count of readers that are copying it right now.
+// A writer that swaps the holder out moves that count into holder->refs;
+// every such reader then finds the slot changed and gives its share back,
+// and whoever brings refs to zero deletes the holder.
+// Relies on user-space pointers fitting in 48 bits.
+template <typename T>
+class AtomicSharedPtr {
+private:
+    typedef SharedPtr<T, AtomicCounting> Pointer;
+
+    struct Holder {
+        Pointer value;
+        std::atomic<std::int64_t> refs;
+
+        explicit Holder(const Pointer& value) : value(value), refs(0) {}
+    };
+
+    static_assert(sizeof(void*) == 8, "AtomicSharedPtr packs a pointer into 48 bits");
+
+    static const int localShift_ = 48;
+    static const std::uint64_t localOne_ = std::uint64_t(1) << localShift_;
+    static const std::uint64_t holderMask_ = localOne_ - 1;
+
+    mutable std::atomic<std::uint64_t> word_;
+
+    static Holder* holderOf_(std::uint64_t word) {
+        return reinterpret_cast<Holder*>(word & holderMask_);
+    }
+
+    static std::int64_t localOf_(std::uint64_t word) {
+        return std::int64_t(word >> localShift_);
+    }
+
+    static std::uint64_t wordOf_(const Pointer& value) {
+        if (!value.block_)
+            return 0;
+        return reinterpret_cast<std::uintptr_t>(new Holder(value));
+    }
+
+    static void releaseHolder_(Holder* holder, std::int64_t refs) {
+        if (holder->refs.fetch_add(refs, std::memory_order_acq_rel) + refs == 0)
+            delete holder;
+    }
+
+    // Returns the pinned word, or 0 if the slot is empty.
+    std::uint64_t pin_() const {
+        std::uint64_t word = word_.load(std::memory_order_relaxed);
+        do {
+            if (!word)
+                return 0;
+        } while (!word_.compare_exchange_weak(word, word + localOne_, std::memory_order_acquire,
+                                              std::memory_order_relaxed));
+        return word + localOne_;
+    }
+
+    void unpin_(Holder* holder) const {
+        std::uint64_t word = word_.load(std::memory_order_relaxed);
+        while (holderOf_(word) == holder)
+            if (word_.compare_exchange_weak(word, word - localOne_, std::memory_order_release,
+                                            std::memory_order_relaxed))
+                return;
+        releaseHolder_(holder, -1);
+    }
+
+    Pointer swapOut_(std::uint64_t word) {
+        Holder* holder = holderOf_(word);
+        if (!holder)
+            return Pointer();
+        Pointer value(holder->value);
+        releaseHolder_(holder, localOf_(word));
+        return value;
+    }
+
+public:
+    AtomicSharedPtr() : word_(0) {}
+
+    AtomicSharedPtr(const Pointer& value) : word_(wordOf_(value)) {}
+
+    AtomicSharedPtr(const AtomicSharedPtr&) = delete;
+
+    AtomicSharedPtr& operator=(const AtomicSharedPtr&) = delete;
+
+    ~AtomicSharedPtr() {
+        if (Holder* holder = holderOf_(word_.load(std::memory_order_acquire)))
+            delete holder;
+    }
+
+    bool is_lock_free() const {
+        return word_.is_lock_free();
+    }
+
+    Pointer load() const {
+        std::uint64_t word = pin_();
+        if (!word)
+            return Pointer();
+        Holder* holder = holderOf_(word);
+        Pointer value(holder->value);
+        unpin_(holder);
+        return value;
+    }
+
+    void store(const Pointer& desired) {
+        exchange(desired);
+    }
+
+    Pointer exchange(const Pointer& desired) {
+        return swapOut_(word_.exchange(wordOf_(desired), std::memory_order_acq_rel));
+    }
+
+    // Succeeds if the slot holds the same pointer sharing ownership with
+    // expected; otherwise loads the current value into expected.
+    bool compare_exchange(Pointer& expected, const Pointer& desired) {
+        while (true) {
+            std::uint64_t word = pin_();
+            Holder* holder = holderOf_(word);
+            Pointer current = holder ? holder->value : Pointer();
+            if (current.ptr_ != expected.ptr_ || current.block_ != expected.block_) {
+                if (holder)
+                    unpin_(holder);
+                expected = current;
+                return false;
             }
+            std::uint64_t replacement = wordOf_(desired);
+            if (!holder) {
+                if (word_.compare_exchange_strong(word, replacement, std::memory_order_acq_rel))
+                    return true;
+                if (Holder* unused = holderOf_(replacement))
+                    delete unused;
+                continue;
+            }
+            while (holderOf_(word) == holder)
+                if (word_.compare_exchange_weak(word, replacement, std::memory_order_acq_rel,
+                                                std::memory_order_relaxed)) {
+                    releaseHolder_(holder, localOf_(word) - 1);
+                    return true;
+                }
+            if (Holder* unused = holderOf_(replacement))
+                delete unused;
+            releaseHolder_(holder, -1);
         }
-        else if (count_ && !*count_)
-            delete count_;
+    }
+};
+
+
+// Base for objects that carry their own reference count. IntrusivePtr finds
+// the count through intrusiveAddRef and intrusiveRelease, so a type can also
+// provide these two functions itself instead of deriving from this class.
+template <class Derived, class Counting = SingleThreadedCounting>
+class IntrusiveRefCounted {
+private:
+    mutable typename Counting::Counter refs_;
+
+protected:
+    IntrusiveRefCounted() : refs_(0) {}
+
+    IntrusiveRefCounted(const IntrusiveRefCounted&) : refs_(0) {}
+
+    IntrusiveRefCounted& operator=(const IntrusiveRefCounted&) {
+        return *this;
     }
 
+    ~IntrusiveRefCounted() {}
+
+public:
     std::size_t use_count() const {
-        return count_ ? *count_ : 0;
+        return Counting::load(refs_);
     }
 
-    bool expired() const {
-        return !count_ || *count_ == 0;
+    friend void intrusiveAddRef(const IntrusiveRefCounted* object) {
+        Counting::increment(object->refs_);
     }
 
-    SharedPtr<T> lock() const {
-        return expired() ? SharedPtr<T>() : SharedPtr<T>(*this);
+    friend void intrusiveRelease(const IntrusiveRefCounted* object) {
+        if (Counting::decrement(object->refs_))
+            delete static_cast<const Derived*>(object);
+    }
+};
+
+template <typename T>
+class IntrusivePtr {
+template <typename U> friend class IntrusivePtr;
+private:
+    T* ptr_;
+
+public:
+    IntrusivePtr() : ptr_(nullptr) {}
+
+    // Pass addRef = false to adopt a reference that was taken earlier.
+    explicit IntrusivePtr(T* ptr, bool addRef = true) : ptr_(ptr) {
+        if (ptr_ && addRef)
+            intrusiveAddRef(ptr_);
+    }
+
+    IntrusivePtr(const IntrusivePtr& another) : ptr_(another.ptr_) {
+        if (ptr_)
+            intrusiveAddRef(ptr_);
+    }
+
+    IntrusivePtr(IntrusivePtr&& another) : ptr_(another.ptr_) {
+        another.ptr_ = nullptr;
+    }
+
+    template <typename U>
+    IntrusivePtr(const IntrusivePtr<U>& another) : ptr_(another.ptr_) {
+        if (ptr_)
+            intrusiveAddRef(ptr_);
+    }
+
+    template <typename U>
+    IntrusivePtr(IntrusivePtr<U>&& another) : ptr_(another.ptr_) {
+        another.ptr_ = nullptr;
+    }
+
+    ~IntrusivePtr() {
+        if (ptr_)
+            intrusiveRelease(ptr_);
+    }
+
+    void swap(IntrusivePtr& another) {
+        std::swap(ptr_, another.ptr_);
+    }
+
+    IntrusivePtr& operator=(const IntrusivePtr& another) {
+        IntrusivePtr(another).swap(*this);
+        return *this;
+    }
+
+    IntrusivePtr& operator=(IntrusivePtr&& another) {
+        IntrusivePtr(std::move(another)).swap(*this);
+        return *this;
+    }
+
+    T* get() const {
+        return ptr_;
+    }
+
+    T* operator->() const {
+        return ptr_;
+    }
+
+    T& operator*() const {
+        return *ptr_;
+    }
+
+    // Gives up the reference without releasing it.
+    T* detach() {
+        T* tmp = ptr_;
+        ptr_ = nullptr;
+        return tmp;
     }
 
     void reset() {
-        WeakPtr<T>().swap(*this);
+        IntrusivePtr().swap(*this);
     }
-};
\ No newline at end of file
+
+    void reset(T* ptr) {
+        IntrusivePtr(ptr).swap(*this);
+    }
+};
+
+template <typename T, class... Args>
+IntrusivePtr<T> MakeIntrusive(Args&&... args) {
+    return IntrusivePtr<T>(new T(std::forward<Args>(args)...));
+}
+
+// For APIs that still take a SharedPtr: the returned pointer owns one
+// intrusive reference and releases it when its last copy dies.
+template <class Counting, typename T>
+SharedPtr<T, Counting> SharedFromIntrusive(const IntrusivePtr<T>& intrusive) {
+    if (!intrusive.get())
+        return SharedPtr<T, Counting>();
+    return SharedPtr<T, Counting>(
+        _smart_pointers::newBlock<_smart_pointers::IntrusiveControlBlock<T, Counting>>(intrusive.get()),
+        intrusive.get());
+}
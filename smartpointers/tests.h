@@ -0,0 +1,268 @@
+#pragma once
+
+#include "smartpointers.h"
+#include "reclamation.h"
+#include <atomic>
+#include <memory>
+#include <random>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "gtest/gtest.h"
+
+
+// Counts live instances so every test can check that nothing leaks and
+// nothing is destroyed twice.
+struct Tracked {
+    static std::atomic<int> alive;
+    int value;
+
+    explicit Tracked(int value = 0) : value(value) {
+        ++alive;
+    }
+
+    Tracked(const Tracked& another) : value(another.value) {
+        ++alive;
+    }
+
+    virtual ~Tracked() {
+        --alive;
+    }
+};
+
+std::atomic<int> Tracked::alive(0);
+
+struct DerivedTracked : Tracked {
+    explicit DerivedTracked(int value) : Tracked(value) {}
+};
+
+// Random copies, moves, resets, weak locks and aliasing over a few slots, mirrored on
+// std::shared_ptr / std::weak_ptr.
+template <class Counting>
+void randomSharedOperations(unsigned seed, int operations) {
+    const int slots = 8;
+    std::mt19937 random(seed);
+    std::vector<SharedPtr<Tracked, Counting>> shared(slots);
+    std::vector<WeakPtr<Tracked, Counting>> weak(slots);
+    std::vector<std::shared_ptr<Tracked>> referenceShared(slots);
+    std::vector<std::weak_ptr<Tracked>> referenceWeak(slots);
+    for (int i = 0; i < operations; ++i) {
+        int a = random() % slots, b = random() % slots;
+        switch (random() % 8) {
+            case 0: {
+                int value = random() % 1000;
+                shared[a] = MakeShared<Tracked, Counting>(value);
+                referenceShared[a] = std::make_shared<Tracked>(value);
+                break;
+            }
+            case 1: {
+                int value = random() % 1000;
+                shared[a] = SharedPtr<Tracked, Counting>(new DerivedTracked(value));
+                referenceShared[a] = std::shared_ptr<Tracked>(new DerivedTracked(value));
+                break;
+            }
+            case 2:
+                shared[a] = shared[b];
+                referenceShared[a] = referenceShared[b];
+                break;
+            case 3:
+                shared[a] = std::move(shared[b]);
+                referenceShared[a] = std::move(referenceShared[b]);
+                break;
+            case 4:
+                shared[a].reset();
+                referenceShared[a].reset();
+                break;
+            case 5:
+                weak[a] = shared[b];
+                referenceWeak[a] = referenceShared[b];
+                break;
+            case 6:
+                shared[a] = weak[b].lock();
+                referenceShared[a] = referenceWeak[b].lock();
+                break;
+            default:
+                shared[a] = SharedPtr<Tracked, Counting>(shared[b], shared[b].get());
+                referenceShared[a] = std::shared_ptr<Tracked>(referenceShared[b], referenceShared[b].get());
+        }
+        for (int k = 0; k < slots; ++k) {
+            ASSERT_EQ(shared[k].use_count(), std::size_t(referenceShared[k].use_count()));
+            ASSERT_EQ(bool(shared[k].get()), bool(referenceShared[k]));
+            if (referenceShared[k]) {
+                ASSERT_EQ(shared[k]->value, referenceShared[k]->value);
+            }
+            ASSERT_EQ(weak[k].expired(), referenceWeak[k].expired());
+        }
+    }
+}
+
+TEST(SharedPtrTest, RandomOperationsMatchStdSharedPtr) {
+    int before = Tracked::alive;
+    randomSharedOperations<SingleThreadedCounting>(1, 20000);
+    EXPECT_EQ(Tracked::alive, before);
+}
+
+TEST(SharedPtrTest, DeleterAndAllocator) {
+    int deleted = 0;
+    {
+        SharedPtr<Tracked> pointer(new Tracked(5), [&deleted](Tracked* object) {
+                                       ++deleted;
+                                       delete object;
+                                   }, std::allocator<int>());
+        SharedPtr<Tracked> copy = pointer;
+        EXPECT_EQ(copy.use_count(), 2u);
+    }
+    EXPECT_EQ(deleted, 1);
+    {
+        auto pointer = AllocateShared<Tracked>(std::allocator<int>(), 7);
+        EXPECT_EQ(pointer->value, 7);
+    }
+    EXPECT_EQ(Tracked::alive, 0);
+}
+
+TEST(SharedPtrTest, RandomOperationsWithAtomicCounting) {
+    int before = Tracked::alive;
+    randomSharedOperations<AtomicCounting>(2, 20000);
+    EXPECT_EQ(Tracked::alive, before);
+}
+
+TEST(SharedPtrTest, CopiesOnManyThreads) {
+    auto pointer = MakeShared<Tracked, AtomicCounting>(1);
+    std::vector<std::thread> threads;
+    for (int k = 0; k < 4; ++k)
+        threads.emplace_back([pointer]() {
+            for (int i = 0; i < 100000; ++i) {
+                SharedPtr<Tracked, AtomicCounting> copy = pointer;
+                WeakPtr<Tracked, AtomicCounting> weak = copy;
+                EXPECT_TRUE(weak.lock().get());
+            }
+        });
+    for (std::thread& thread : threads)
+        thread.join();
+    EXPECT_EQ(pointer.use_count(), 1u);
+}
+
+TEST(AtomicSharedPtrTest, ConcurrentLoadStoreAndCompareExchange) {
+    {
+        AtomicSharedPtr<Tracked> slot(MakeShared<Tracked, AtomicCounting>(0));
+        std::atomic<int> increments(0);
+        std::vector<std::thread> threads;
+        for (int k = 0; k < 4; ++k)
+            threads.emplace_back([&slot, &increments, k]() {
+                std::mt19937 random(k);
+                for (int i = 0; i < 20000; ++i) {
+                    if (random() % 4 == 0) {
+                        auto current = slot.load();
+                        ASSERT_TRUE(current.get());
+                        ASSERT_GE(current->value, 0);
+                        continue;
+                    }
+                    auto expected = slot.load();
+                    while (!slot.compare_exchange(expected, MakeShared<Tracked, AtomicCounting>(expected->value + 1))) {}
+                    ++increments;
+                }
+            });
+        for (std::thread& thread : threads)
+            thread.join();
+        EXPECT_EQ(slot.load()->value, increments.load());
+        slot.store(SharedPtr<Tracked, AtomicCounting>());
+        EXPECT_FALSE(slot.load().get());
+    }
+    EXPECT_EQ(Tracked::alive, 0);
+}
+
+// Control blocks come from thread-cached pools; the last owner may be on
+// another thread, which then frees the block into its own cache.
+TEST(SharedPtrTest, BlocksReleasedOnOtherThreads) {
+    std::vector<SharedPtr<Tracked, AtomicCounting>> pointers;
+    for (int i = 0; i < 20000; ++i)
+        pointers.push_back(i % 2 ? MakeShared<Tracked, AtomicCounting>(i)
+                                 : SharedPtr<Tracked, AtomicCounting>(new DerivedTracked(i)));
+    std::vector<std::thread> threads;
+    for (int k = 0; k < 4; ++k)
+        threads.emplace_back([&pointers, k]() {
+            for (std::size_t i = k; i < pointers.size(); i += 4) {
+                SharedPtr<Tracked, AtomicCounting> owned = std::move(pointers[i]);
+                ASSERT_EQ(owned->value, int(i));
+                owned = MakeShared<Tracked, AtomicCounting>(-1);
+            }
+        });
+    for (std::thread& thread : threads)
+        thread.join();
+    EXPECT_EQ(Tracked::alive, 0);
+}
+
+struct Message : IntrusiveRefCounted<Message, AtomicCounting>, Tracked {
+    explicit Message(int value) : Tracked(value) {}
+};
+
+TEST(IntrusivePtrTest, SharesTheCountWithSharedPtr) {
+    {
+        IntrusivePtr<Message> message = MakeIntrusive<Message>(4);
+        IntrusivePtr<Message> copy = message;
+        EXPECT_EQ(message->use_count(), 2u);
+        SharedPtr<Message, AtomicCounting> shared = SharedFromIntrusive<AtomicCounting>(message);
+        copy.reset();
+        message.reset();
+        EXPECT_EQ(shared->value, 4);
+    }
+    EXPECT_EQ(Tracked::alive, 0);
+}
+
+TEST(UniquePtrTest, DeleterAndArrays) {
+    int deleted = 0;
+    auto deleter = [&deleted](Tracked* object) {
+        ++deleted;
+        delete object;
+    };
+    {
+        UniquePtr<Tracked, decltype(deleter)> pointer(new Tracked(1), deleter);
+        UniquePtr<Tracked, decltype(deleter)> moved(std::move(pointer));
+        EXPECT_FALSE(pointer);
+        moved.reset(new Tracked(2));
+        EXPECT_EQ(deleted, 1);
+    }
+    EXPECT_EQ(deleted, 2);
+    UniquePtr<Tracked[]> array(new Tracked[3]);
+    array[2].value = 5;
+    EXPECT_EQ(array[2].value, 5);
+    array.reset();
+    EXPECT_EQ(Tracked::alive, 0);
+}
+
+TEST(ReclamationTest, RetiredObjectsWaitForGuards) {
+    ReclamationDomain domain;
+    {
+        SharedPtr<Tracked> pointer(new Tracked(1), DeferredDelete<Tracked>(domain));
+        ReclamationDomain::Guard guard(domain);
+        pointer.reset();
+        EXPECT_EQ(domain.drain(), 0u);
+        EXPECT_EQ(Tracked::alive, 1);
+    }
+    EXPECT_EQ(domain.drain(), 1u);
+    EXPECT_EQ(Tracked::alive, 0);
+}
+
+struct TrackedDeleter {
+    void operator()(Tracked* object) const {
+        delete object;
+    }
+};
+
+TEST(UniquePtrTest, ConvertingMoveIsConstrained) {
+    static_assert(std::is_constructible<UniquePtr<Tracked>, UniquePtr<DerivedTracked>&&>::value,
+                  "a pointer to a derived class converts");
+    static_assert(!std::is_constructible<UniquePtr<DerivedTracked>, UniquePtr<Tracked>&&>::value,
+                  "a pointer to a base class does not");
+    static_assert(!std::is_constructible<UniquePtr<Tracked>, UniquePtr<DerivedTracked[]>&&>::value,
+                  "an array must not be deleted through the single-object form");
+    static_assert(!std::is_constructible<UniquePtr<Tracked>, UniquePtr<Tracked, TrackedDeleter>&&>::value,
+                  "the deleter must convert");
+    static_assert(!std::is_constructible<UniquePtr<Tracked>, UniquePtr<int>&&>::value,
+                  "unrelated pointers do not convert");
+
+    UniquePtr<Tracked> pointer(UniquePtr<DerivedTracked>(new DerivedTracked(3)));
+    EXPECT_EQ(pointer->value, 3);
+    pointer.reset();
+    EXPECT_EQ(Tracked::alive, 0);
+}